@@ -7,42 +7,146 @@
 #define NEED_sv_2pvbyte
 #include "ppport.h"
 
+#ifndef SvPVbyte_nomg
+#define SvPVbyte_nomg SvPVbyte
+#endif
+
+#ifndef hv_stores
+#define hv_stores(hv, key, val) hv_store(hv, key, sizeof(key) - 1, val, 0)
+#endif
+
 #include "src/csnappy_compress.c"
 #include "src/csnappy_decompress.c"
+#include "src/csnappy_analyze.c"
+#include "src/csnappy_dispatch.c"
+
+static uint32_t nt_threshold = CSNAPPY_NT_THRESHOLD_DEFAULT;
+
+/*
+ * Working memory starting on a cache line, so the hash table spans as few
+ * lines as it can. *raw is what to Safefree() afterwards.
+ */
+static void *
+aligned_workmem(size_t bytes, char **raw)
+{
+    Newx(*raw, bytes + CSNAPPY_WORKMEM_ALIGN - 1, char);
+    if (! *raw)
+        return NULL;
+    return (void *)(((uintptr_t)*raw + CSNAPPY_WORKMEM_ALIGN - 1) &
+                    ~(uintptr_t)(CSNAPPY_WORKMEM_ALIGN - 1));
+}
+
+static const char * const tag_names[4] = {
+    "literal", "copy_1", "copy_2", "copy_4"
+};
+
+static const char * const path_names[CSNAPPY_PATHS] = {
+    "bulk", "bulk_pattern", "run", "fast", "incremental_fast", "incremental"
+};
+
+struct element_callback {
+    SV *sv;
+    uint32_t header_len;
+};
+
+/* Hands each element to the Perl callback of analyze(), as a hash. */
+static void
+call_element(void *arg, const struct csnappy_element *e)
+{
+    dTHX;
+    dSP;
+    const struct element_callback *cb = (const struct element_callback *)arg;
+    HV *hv = newHV();
+
+    hv_stores(hv, "tag", newSVpv(tag_names[e->tag], 0));
+    hv_stores(hv, "in_pos", newSVuv(cb->header_len + e->in_pos));
+    hv_stores(hv, "in_len", newSVuv(e->in_len));
+    hv_stores(hv, "out_pos", newSVuv(e->out_pos));
+    hv_stores(hv, "length", newSVuv(e->length));
+    if (e->tag) {
+        hv_stores(hv, "offset", newSVuv(e->offset));
+        hv_stores(hv, "path", newSVpv(path_names[e->path], 0));
+    }
+    ENTER;
+    SAVETMPS;
+    PUSHMARK(SP);
+    mXPUSHs(newRV_noinc((SV *)hv));
+    PUTBACK;
+    call_sv(cb->sv, G_DISCARD);
+    FREETMPS;
+    LEAVE;
+}
+
+/* A histogram as an array, up to its last bucket that is not empty. */
+static SV *
+histogram_av(pTHX_ const uint64_t *buckets)
+{
+    AV *av = newAV();
+    int i, last = CSNAPPY_HISTOGRAM_BUCKETS - 1;
+
+    while (last >= 0 && ! buckets[last])
+        --last;
+    for (i = 0; i <= last; ++i)
+        av_push(av, newSVuv((UV)buckets[i]));
+    return newRV_noinc((SV *)av);
+}
 
 MODULE = Compress::Snappy    PACKAGE = Compress::Snappy
 
 PROTOTYPES: ENABLE
 
+BOOT:
+    csnappy_select_kernels(NULL);
+
 SV *
-compress (sv)
+compress (sv, mode_sv = NULL)
     SV *sv
+    SV *mode_sv
+PROTOTYPE: $;$
 PREINIT:
     char *src, *dest;
     STRLEN src_len;
     uint32_t dest_len;
     void *working_memory;
+    char *raw;
+    int mode = CSNAPPY_MODE_FAST;
 CODE:
-    if (SvROK(sv) && ! SvAMAGIC(sv))
+    if (mode_sv && SvOK(mode_sv)) {
+        const char *name = SvPV_nolen(mode_sv);
+        if (strEQ(name, "dual"))
+            mode = CSNAPPY_MODE_DUAL_HASH;
+        else if (strEQ(name, "tagged"))
+            mode = CSNAPPY_MODE_TAGGED;
+        else if (strEQ(name, "decode"))
+            mode = CSNAPPY_MODE_DECODE_FAST;
+        else if (! strEQ(name, "fast"))
+            croak("Compress::Snappy::compress: unknown mode '%s'", name);
+    }
+    /* Tied and shared scalars have no value to test until fetched. */
+    SvGETMAGIC(sv);
+    if (SvROK(sv) && ! SvAMAGIC(sv)) {
         sv = SvRV(sv);
+        SvGETMAGIC(sv);
+    }
     if (! SvOK(sv))
         XSRETURN_NO;
-    src = SvPVbyte(sv, src_len);
+    src = SvPVbyte_nomg(sv, src_len);
     if (! src_len)
         XSRETURN_NO;
     dest_len = csnappy_max_compressed_length(src_len);
     if (! dest_len)
         XSRETURN_UNDEF;
-    Newx(working_memory, CSNAPPY_WORKMEM_BYTES, void *);
+    working_memory = aligned_workmem(CSNAPPY_MODE_WORKMEM_BYTES(
+                         CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO), &raw);
     if (! working_memory)
         XSRETURN_UNDEF;
     RETVAL = newSV(dest_len);
     dest = SvPVX(RETVAL);
     if (! dest)
         XSRETURN_UNDEF;
-    csnappy_compress(src, src_len, dest, &dest_len, working_memory,
-                     CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO);
-    Safefree(working_memory);
+    csnappy_compress_mode(src, src_len, dest, &dest_len, working_memory,
+                          CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO, mode);
+    Safefree(raw);
     SvCUR_set(RETVAL, dest_len);
     SvPOK_on(RETVAL);
 OUTPUT:
@@ -53,31 +157,239 @@ decompress (sv)
     SV *sv
 ALIAS:
     uncompress = 1
+    decompress_trusted = 2
+    decompress_twophase = 3
 PREINIT:
     char *src, *dest;
     STRLEN src_len;
     uint32_t dest_len;
-    int header_len;
+    int header_len, ret;
 CODE:
-    PERL_UNUSED_VAR(ix); /* -W */
-    if (SvROK(sv))
+    SvGETMAGIC(sv);
+    if (SvROK(sv)) {
         sv = SvRV(sv);
+        SvGETMAGIC(sv);
+    }
     if (! SvOK(sv))
         XSRETURN_NO;
-    src = SvPVbyte(sv, src_len);
+    src = SvPVbyte_nomg(sv, src_len);
     if (! src_len)
         XSRETURN_NO;
     header_len = csnappy_get_uncompressed_length(src, src_len, &dest_len);
     if (0 > header_len || ! dest_len)
         XSRETURN_UNDEF;
-    RETVAL = newSV(dest_len);
-    dest = SvPVX(RETVAL);
-    if (! dest)
-        XSRETURN_UNDEF;
-    if (csnappy_decompress_noheader(src + header_len, src_len - header_len,
-                                    dest, &dest_len))
+    if (ix == 2) {
+        RETVAL = newSV((STRLEN)dest_len + CSNAPPY_TRUSTED_SLOP_BYTES);
+        dest = SvPVX(RETVAL);
+        if (! dest)
+            XSRETURN_UNDEF;
+        ret = csnappy_decompress_noheader_trusted(src + header_len,
+                  src_len - header_len, dest, &dest_len);
+    }
+    else {
+        RETVAL = newSV(dest_len);
+        dest = SvPVX(RETVAL);
+        if (! dest)
+            XSRETURN_UNDEF;
+        if (ix == 3)
+            ret = csnappy_decompress_noheader_twophase(src + header_len,
+                      src_len - header_len, dest, &dest_len);
+        else if (nt_threshold && dest_len >= nt_threshold) {
+            char *raw;
+            void *working_memory = aligned_workmem(
+                      CSNAPPY_NT_WORKMEM_BYTES, &raw);
+            ret = csnappy_decompress_noheader_nt(src + header_len,
+                      src_len - header_len, dest, &dest_len,
+                      working_memory, nt_threshold);
+            Safefree(raw);
+        }
+        else
+            ret = csnappy_decompress_noheader(src + header_len,
+                      src_len - header_len, dest, &dest_len);
+    }
+    if (ret)
         XSRETURN_UNDEF;
     SvCUR_set(RETVAL, dest_len);
     SvPOK_on(RETVAL);
 OUTPUT:
     RETVAL
+
+void
+decompress_multi (...)
+PREINIT:
+    const char **src;
+    char **dest;
+    uint32_t *src_len, *dest_len;
+    int *status, header_len;
+    SV **out, *sv;
+    STRLEN len;
+    I32 i, *which, n = 0;
+    const char *buf;
+PPCODE:
+    /* Freed even if fetching or stringifying an argument dies. */
+    Newx(src, items, const char *);
+    SAVEFREEPV(src);
+    Newx(dest, items, char *);
+    SAVEFREEPV(dest);
+    Newx(src_len, items, uint32_t);
+    SAVEFREEPV(src_len);
+    Newx(dest_len, items, uint32_t);
+    SAVEFREEPV(dest_len);
+    Newx(status, items, int);
+    SAVEFREEPV(status);
+    Newx(out, items, SV *);
+    SAVEFREEPV(out);
+    Newx(which, items, I32);
+    SAVEFREEPV(which);
+    /* The same answers as decompress() for what there is nothing to do. */
+    for (i = 0; i < items; ++i) {
+        sv = ST(i);
+        out[i] = &PL_sv_undef;
+        SvGETMAGIC(sv);
+        if (SvROK(sv)) {
+            sv = SvRV(sv);
+            SvGETMAGIC(sv);
+        }
+        if (! SvOK(sv)) {
+            out[i] = &PL_sv_no;
+            continue;
+        }
+        buf = SvPVbyte_nomg(sv, len);
+        if (! len) {
+            out[i] = &PL_sv_no;
+            continue;
+        }
+        header_len = csnappy_get_uncompressed_length(buf, len, &dest_len[n]);
+        if (0 > header_len || ! dest_len[n])
+            continue;
+        out[i] = sv_2mortal(newSV(dest_len[n]));
+        src[n] = buf + header_len;
+        src_len[n] = len - header_len;
+        dest[n] = SvPVX(out[i]);
+        which[n++] = i;
+    }
+    csnappy_decompress_noheader_multi(n, src, src_len, dest, dest_len,
+                                      status);
+    for (i = 0; i < n; ++i) {
+        if (status[i]) {
+            out[which[i]] = &PL_sv_undef;
+            continue;
+        }
+        SvCUR_set(out[which[i]], dest_len[i]);
+        SvPOK_on(out[which[i]]);
+    }
+    EXTEND(SP, items);
+    for (i = 0; i < items; ++i)
+        PUSHs(out[i]);
+
+UV
+nt_threshold (...)
+CODE:
+    if (items > 1)
+        croak("Usage: Compress::Snappy::nt_threshold([bytes])");
+    if (items) {
+        UV bytes = SvUV(ST(0));
+        nt_threshold = bytes > 0xffffffff ? 0xffffffff : (uint32_t)bytes;
+    }
+    RETVAL = nt_threshold;
+OUTPUT:
+    RETVAL
+
+void
+kernel (...)
+PPCODE:
+    if (items > 1)
+        croak("Usage: Compress::Snappy::kernel([name])");
+    if (items) {
+        const char *name = SvOK(ST(0)) ? SvPV_nolen(ST(0)) : NULL;
+        if (csnappy_select_kernels(name))
+            XSRETURN_UNDEF;
+    }
+    mXPUSHp(csnappy_kernels_name(), strlen(csnappy_kernels_name()));
+
+void
+kernels ()
+PREINIT:
+    int i;
+    const char *name;
+PPCODE:
+    for (i = 0; (name = csnappy_kernels_available(i)); ++i)
+        mXPUSHp(name, strlen(name));
+
+SV *
+analyze (sv, callback=NULL)
+    SV *sv
+    SV *callback
+PROTOTYPE: $;$
+PREINIT:
+    const char *src;
+    STRLEN src_len;
+    uint32_t dest_len, i;
+    int header_len;
+    struct csnappy_stats stats;
+    struct element_callback cb;
+    HV *hv, *elements, *bytes, *paths;
+    AV *blocks;
+CODE:
+    SvGETMAGIC(sv);
+    if (SvROK(sv)) {
+        sv = SvRV(sv);
+        SvGETMAGIC(sv);
+    }
+    if (! SvOK(sv))
+        XSRETURN_UNDEF;
+    src = SvPVbyte_nomg(sv, src_len);
+    header_len = csnappy_get_uncompressed_length(src, src_len, &dest_len);
+    if (0 > header_len)
+        XSRETURN_UNDEF;
+    Zero(&stats, 1, struct csnappy_stats);
+    stats.blocks = (dest_len + CSNAPPY_ANALYZE_BLOCK_SIZE - 1) /
+                   CSNAPPY_ANALYZE_BLOCK_SIZE;
+    Newxz(stats.block_in, stats.blocks ? stats.blocks : 1, uint32_t);
+    /* Freed even if the callback dies. */
+    SAVEFREEPV(stats.block_in);
+    cb.sv = callback && SvOK(callback) ? callback : NULL;
+    cb.header_len = header_len;
+    if (csnappy_analyze(src + header_len, src_len - header_len, dest_len,
+                        &stats, cb.sv ? call_element : NULL, &cb))
+        XSRETURN_UNDEF;
+
+    hv = newHV();
+    RETVAL = newRV_noinc((SV *)hv);
+    hv_stores(hv, "compressed", newSVuv(src_len));
+    hv_stores(hv, "uncompressed", newSVuv(stats.out_len));
+    hv_stores(hv, "header", newSVuv(header_len));
+    elements = newHV();
+    bytes = newHV();
+    for (i = 0; i < 4; ++i) {
+        hv_store(elements, tag_names[i], strlen(tag_names[i]),
+                 newSVuv((UV)stats.elements[i]), 0);
+        hv_store(bytes, tag_names[i], strlen(tag_names[i]),
+                 newSVuv((UV)stats.bytes[i]), 0);
+    }
+    hv_stores(hv, "elements", newRV_noinc((SV *)elements));
+    hv_stores(hv, "bytes", newRV_noinc((SV *)bytes));
+    hv_stores(hv, "matches", newSVuv((UV)stats.matches));
+    hv_stores(hv, "literal_lengths", histogram_av(aTHX_ stats.literal_lengths));
+    hv_stores(hv, "match_lengths", histogram_av(aTHX_ stats.match_lengths));
+    hv_stores(hv, "offsets", histogram_av(aTHX_ stats.offsets));
+    paths = newHV();
+    for (i = 0; i < CSNAPPY_PATHS; ++i)
+        hv_store(paths, path_names[i], strlen(path_names[i]),
+                 newSVuv((UV)stats.paths[i]), 0);
+    hv_stores(hv, "paths", newRV_noinc((SV *)paths));
+    /* Each as [compressed bytes, uncompressed bytes]. */
+    blocks = newAV();
+    for (i = 0; i < stats.blocks; ++i) {
+        AV *block = newAV();
+        const uint32_t start = i * CSNAPPY_ANALYZE_BLOCK_SIZE;
+        const uint32_t out = start >= stats.out_len ? 0 :
+                             stats.out_len - start;
+        av_push(block, newSVuv(stats.block_in[i]));
+        av_push(block, newSVuv(out < CSNAPPY_ANALYZE_BLOCK_SIZE ? out :
+                                   CSNAPPY_ANALYZE_BLOCK_SIZE));
+        av_push(blocks, newRV_noinc((SV *)block));
+    }
+    hv_stores(hv, "blocks", newRV_noinc((SV *)blocks));
+OUTPUT:
+    RETVAL
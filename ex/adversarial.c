@@ -0,0 +1,526 @@
+/*
+Worst-case throughput of csnappy_decompress_noheader() and
+csnappy_compress_fragment(), on inputs built to make them as slow as they
+can be, next to their throughput on typical data: what a server taking
+data from untrusted clients has to be sized for.
+
+Built on its own from the sources, from the top of the distribution:
+
+    cc -O2 -DHAVE_BUILTIN_CTZ -DHAVE_BUILTIN_CPU_SUPPORTS \
+        -o adversarial ex/adversarial.c
+
+and run on sample files of typical data, or on made up text without:
+
+    ./adversarial [-n runs] [-t msecs] [-s bytes] [-k kernels] [file ...]
+
+Each input is -s bytes (1 MiB by default) uncompressed, compressed 32 KiB
+fragment by fragment, as csnappy_compress() does. Reports the median of
+the runs (5 by default, each at least 100 ms long) as MB/s of uncompressed
+data, and for the decompressor also of the compressed data, which is what
+clients send; then the slowest input of each kind against the typical one.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/csnappy_compress.c"
+#include "../src/csnappy_decompress.c"
+#include "../src/csnappy_dispatch.c"
+
+struct input {
+	const char *name;
+	char *data;
+	uint32_t len;
+	/* For the decompressor, how many streams data is, of out_len each. */
+	uint32_t streams, out_len;
+};
+
+static int runs = 5;
+static double min_time = 0.1;
+static uint32_t size = 1 << 20;
+
+static char *out, *wmem;
+static uint64_t rng = 0x9e3779b97f4a7c15ull;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint32_t random32(void)
+{
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+	return rng >> 32;
+}
+
+/*
+ * Elements written by hand rather than by the compressor, which would
+ * never choose most of these: any length and offset, and lengths of
+ * literals in as many bytes as asked, up to 4, or as few as they fit in
+ * with len_bytes 0.
+ */
+static char *literal(char *op, const char *p, uint32_t len, int len_bytes)
+{
+	int i;
+	if (!len)
+		return op;
+	if (!len_bytes && len > 60)
+		len_bytes = len <= 1 << 8 ? 1 : len <= 1 << 16 ? 2 :
+			    len <= 1 << 24 ? 3 : 4;
+	if (!len_bytes) {
+		*op++ = (char)((len - 1) << 2);
+	} else {
+		*op++ = (char)((59 + len_bytes) << 2);
+		for (i = 0; i < len_bytes; ++i)
+			*op++ = (char)((len - 1) >> (8 * i));
+	}
+	memcpy(op, p, len);
+	return op + len;
+}
+
+static char *copy(char *op, uint32_t offset, uint32_t len)
+{
+	if (len >= 4 && len < 12 && offset < 2048) {
+		*op++ = (char)(1 | (len - 4) << 2 | (offset >> 8) << 5);
+		*op++ = (char)offset;
+	} else if (offset < 65536) {
+		*op++ = (char)(2 | (len - 1) << 2);
+		*op++ = (char)offset;
+		*op++ = (char)(offset >> 8);
+	} else {
+		*op++ = (char)(3 | (len - 1) << 2);
+		*op++ = (char)offset;
+		*op++ = (char)(offset >> 8);
+		*op++ = (char)(offset >> 16);
+		*op++ = (char)(offset >> 24);
+	}
+	return op;
+}
+
+/* calloc(), as -Wmaybe-uninitialized cannot tell that the loop fills it. */
+static char *random_bytes(uint32_t len)
+{
+	char *p = calloc(len, 1);
+	uint32_t i;
+	for (i = 0; i < len; ++i)
+		p[i] = (char)random32();
+	return p;
+}
+
+static struct input stream(const char *name, char *start, char *end)
+{
+	struct input in;
+	in.name = name;
+	in.data = start;
+	in.len = end - start;
+	in.streams = 1;
+	in.out_len = size;
+	return in;
+}
+
+/*
+ * Copies of 4 bytes at offset 1: a pattern copy, IncrementalCopyFastPath's
+ * shuffle, for every 4 bytes of output. Only the copies near the end of
+ * the buffers go through SAW__AppendFromSelf instead.
+ */
+static struct input offset_1(void)
+{
+	char *start = malloc(size), *op = literal(start, "a", 1, 0);
+	uint32_t n;
+	for (n = 1; n + 4 <= size; n += 4)
+		op = copy(op, 1, 4);
+	op = literal(op, "aaaa", size - n, 0);
+	return stream("copies of 4 at offset 1", start, op);
+}
+
+/*
+ * The same at offsets 2 to 7 in turn, too short for the 16 byte moves of
+ * longer offsets, so that every copy is a pattern copy with a different
+ * shuffle mask from the last.
+ */
+static struct input offsets_2_to_7(void)
+{
+	char *start = malloc(size), *op, *p = random_bytes(8);
+	uint32_t n;
+	op = literal(start, p, 8, 0);
+	for (n = 8; n + 4 <= size; n += 4)
+		op = copy(op, 2 + n / 4 % 6, 4);
+	op = literal(op, p, size - n, 0);
+	free(p);
+	return stream("copies of 4 at offsets 2-7", start, op);
+}
+
+/* The most elements per byte of output the fast path can have. */
+static struct input literal_copy(void)
+{
+	char *start = malloc(size), *op, *p = random_bytes(size);
+	uint32_t n;
+	op = literal(start, p, 8, 0);
+	for (n = 8; n + 5 <= size; n += 5) {
+		op = literal(op, p + n, 1, 0);
+		op = copy(op, 8, 4);
+	}
+	op = literal(op, p, size - n, 0);
+	free(p);
+	return stream("literal of 1, copy of 4", start, op);
+}
+
+static struct input literals_1(void)
+{
+	char *start = malloc(2 * size), *op = start, *p = random_bytes(size);
+	uint32_t n;
+	for (n = 0; n < size; ++n)
+		op = literal(op, p + n, 1, 0);
+	free(p);
+	return stream("literals of 1", start, op);
+}
+
+/*
+ * Literals too long for the short literal fast path, with their lengths
+ * in 1 to 4 bytes after the tag, so that the input runs out right after
+ * a length byte at every offset from the end of a buffer.
+ */
+static struct input long_form_literals(void)
+{
+	char *start = malloc(2 * size), *op = start, *p = random_bytes(size);
+	uint32_t n, len;
+	for (n = 0; n < size; n += len) {
+		len = 61 + random32() % 16;
+		if (len > size - n)
+			len = size - n;
+		op = literal(op, p + n, len, 1 + n % 4);
+	}
+	free(p);
+	return stream("literals of 61-76, 1-4 length bytes", start, op);
+}
+
+/* Copies of 1 byte from anywhere in the output, 5 bytes of input each. */
+static struct input far_copies(void)
+{
+	char *start = malloc(5 * size + 64), *op, *p = random_bytes(64);
+	uint32_t n;
+	op = literal(start, p, 64, 0);
+	for (n = 64; n < size; ++n)
+		op = copy(op, 1 + random32() % n, 1);
+	free(p);
+	return stream("copies of 1 at random offsets", start, op);
+}
+
+/* Outputs of 64 bytes, all of it decoded by the careful tail loop. */
+static struct input short_streams(void)
+{
+	char *start = malloc(size), *op = start, *p = random_bytes(4);
+	struct input in;
+	uint32_t n, i;
+	for (n = 0; n + 64 <= size; n += 64) {
+		op = literal(op, p, 4, 0);
+		for (i = 0; i < 15; ++i)
+			op = copy(op, 4, 4);
+	}
+	free(p);
+	in = stream("streams of 64 bytes", start, op);
+	in.streams = size / 64;
+	in.out_len = 64;
+	return in;
+}
+
+/* Random bytes: no matches, and the match search skipping ahead. */
+static struct input random_data(void)
+{
+	struct input in = { "random bytes", random_bytes(size), size, 0, 0 };
+	return in;
+}
+
+/* Two symbols: a match at every byte, most of them short. */
+static struct input binary_alphabet(void)
+{
+	struct input in = { "two symbols", malloc(size), size, 0, 0 };
+	uint32_t i;
+	for (i = 0; i < size; ++i)
+		in.data[i] = "ab"[random32() & 1];
+	return in;
+}
+
+/*
+ * One of a few 4-byte words, then a random byte: a copy of 4 and a literal
+ * of 1 for every 5 bytes, and no run of misses for the search to skip.
+ */
+static struct input short_matches(void)
+{
+	struct input in = { "4-byte words and a random byte", malloc(size),
+			    size, 0, 0 };
+	char *words = random_bytes(4 * 256);
+	uint32_t i;
+	for (i = 0; i + 5 <= size; i += 5) {
+		memcpy(in.data + i, words + 4 * (random32() % 256), 4);
+		in.data[i + 4] = (char)random32();
+	}
+	for (; i < size; ++i)
+		in.data[i] = 0;
+	free(words);
+	return in;
+}
+
+/*
+ * Words of 4 bytes that all hash to one slot of the table, so that every
+ * aligned lookup finds a candidate that is some other word, and matches
+ * that end after 4 bytes.
+ */
+static struct input hash_collisions(void)
+{
+	struct input in = { "colliding 4-byte words", malloc(size), size, 0,
+			    0 };
+	const int shift = 33 - CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO;
+	uint32_t words[4096], w, i, n = 0;
+	while (n < 4096) {
+		w = random32();
+		if ((uint32_t)(w * UINT32_C(0x1e35a7bd)) >> shift == 0)
+			words[n++] = w;
+	}
+	for (i = 0; i + 4 <= size; i += 4) {
+		w = words[random32() % 4096];
+		in.data[i] = (char)w;
+		in.data[i + 1] = (char)(w >> 8);
+		in.data[i + 2] = (char)(w >> 16);
+		in.data[i + 3] = (char)(w >> 24);
+	}
+	for (; i < size; ++i)
+		in.data[i] = 0;
+	return in;
+}
+
+/* Made up text, when no files are given. */
+static struct input text(void)
+{
+	static const char *words[] = {
+		"the", "of", "and", "to", "in", "is", "that", "for", "it",
+		"as", "with", "was", "on", "be", "by", "this", "compressed",
+		"data", "stream", "buffer", "length", "offset", "literal",
+		"copy", "block", "input", "output", "server", "client",
+	};
+	const unsigned nwords = sizeof(words) / sizeof(words[0]);
+	struct input in = { "made up text", malloc(size), size, 0, 0 };
+	uint32_t i = 0, len;
+	const char *w;
+	while (i < size) {
+		/* Mostly the first words, as in real text. */
+		w = words[random32() % (1 + random32() % nwords)];
+		len = strlen(w);
+		if (len + 1 > size - i)
+			len = size - i - 1;
+		memcpy(in.data + i, w, len);
+		i += len;
+		in.data[i++] = random32() % 12 ? ' ' : '\n';
+	}
+	return in;
+}
+
+static struct input file(const char *name)
+{
+	struct input in = { name, malloc(size), size, 0, 0 };
+	uint32_t i = 0;
+	size_t n;
+	FILE *fp = fopen(name, "rb");
+	if (!fp) {
+		perror(name);
+		exit(1);
+	}
+	/* Repeated if it is short, to make up the size. */
+	while (i < size) {
+		n = fread(in.data + i, 1, size - i, fp);
+		if (!n) {
+			if (!i) {
+				fprintf(stderr, "adversarial: %s is empty\n",
+					name);
+				exit(1);
+			}
+			rewind(fp);
+		}
+		i += n;
+	}
+	fclose(fp);
+	return in;
+}
+
+/* Room for input compressed fragment by fragment, each with its slack. */
+static uint32_t compressed_bound(uint32_t len)
+{
+	return csnappy_max_compressed_length(len) + 32 * (len / kBlockSize);
+}
+
+static char *compress_all(const struct input *in, char *op)
+{
+	uint32_t i, len;
+	for (i = 0; i < in->len; i += len) {
+		len = in->len - i < kBlockSize ? in->len - i : kBlockSize;
+		op = csnappy_compress_fragment(in->data + i, len, op, wmem,
+					      CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO);
+	}
+	return op;
+}
+
+static void decompress_all(const struct input *in)
+{
+	const char *ip = in->data;
+	uint32_t i, len, stream_len = in->len / in->streams;
+	for (i = 0; i < in->streams; ++i, ip += stream_len) {
+		len = in->out_len;
+		if (csnappy_decompress_noheader(ip, stream_len, out, &len)
+				!= CSNAPPY_E_OK || len != in->out_len) {
+			fprintf(stderr, "adversarial: %s does not decompress\n",
+				in->name);
+			exit(1);
+		}
+	}
+}
+
+static int by_value(const void *a, const void *b)
+{
+	const double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+/* Median runs of in, in MB/s of its uncompressed bytes. */
+static double measure(const struct input *in, int decompressing)
+{
+	double t, mbps[64];
+	long reps = 1, i;
+	int r;
+
+	t = now();
+	do {
+		for (i = 0; i < reps; i++)
+			decompressing ? decompress_all(in)
+				      : (void)compress_all(in, out);
+		t = now() - t;
+		if (t >= min_time)
+			break;
+		reps *= 2;
+		t = now();
+	} while (1);
+	for (r = 0; r < runs; r++) {
+		t = now();
+		for (i = 0; i < reps; i++)
+			decompressing ? decompress_all(in)
+				      : (void)compress_all(in, out);
+		mbps[r] = (double)size * reps / (now() - t) / 1e6;
+	}
+	qsort(mbps, runs, sizeof(mbps[0]), by_value);
+	return mbps[runs / 2];
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: adversarial [-n runs] [-t msecs] [-s bytes] "
+		"[-k kernels] [file ...]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	struct input (*const decoder_cases[])(void) = {
+		offset_1, offsets_2_to_7, literal_copy, literals_1,
+		long_form_literals, far_copies, short_streams,
+	};
+	struct input (*const encoder_cases[])(void) = {
+		random_data, binary_alphabet, short_matches, hash_collisions,
+	};
+	const int ndecoder = sizeof(decoder_cases) / sizeof(decoder_cases[0]);
+	const int nencoder = sizeof(encoder_cases) / sizeof(encoder_cases[0]);
+	struct input *typical, in;
+	double mbps, typical_c = 0, typical_d = 0, worst_c = 0, worst_d = 0;
+	const char *worst_c_name = NULL, *worst_d_name = NULL;
+	const char *kernels = NULL;
+	int opt, i, ntypical;
+
+	while ((opt = getopt(argc, argv, "n:t:s:k:")) != -1) {
+		switch (opt) {
+		case 'n': runs = atoi(optarg); break;
+		case 't': min_time = atof(optarg) / 1000; break;
+		case 's': size = strtoul(optarg, NULL, 0); break;
+		case 'k': kernels = optarg; break;
+		default: usage();
+		}
+	}
+	if (runs < 1 || runs > 64 || size < 4096 || size > 1u << 28)
+		usage();
+	if (kernels && csnappy_select_kernels(kernels)) {
+		fprintf(stderr, "adversarial: kernels %s not available\n",
+			kernels);
+		exit(1);
+	}
+	out = malloc(compressed_bound(size));
+	wmem = malloc(1 << CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO);
+
+	ntypical = argc > optind ? argc - optind : 1;
+	typical = malloc(ntypical * sizeof(*typical));
+	for (i = 0; i < ntypical; ++i)
+		typical[i] = argc > optind ? file(argv[optind + i]) : text();
+
+	printf("kernels %s, %u bytes, median of %d runs, MB/s\n",
+	       csnappy_kernels_name(), size, runs);
+	printf("%-38s %10s %10s %10s\n", "", "compress", "decompress",
+	       "compressed");
+	for (i = 0; i < ntypical; ++i) {
+		const char *name = strrchr(typical[i].name, '/');
+		struct input packed = typical[i];
+		double c = measure(&typical[i], 0), d;
+		packed.data = malloc(compressed_bound(size));
+		packed.len = compress_all(&typical[i], packed.data) -
+			     packed.data;
+		packed.streams = 1;
+		packed.out_len = size;
+		d = measure(&packed, 1);
+		printf("%-38.38s %10.1f %10.1f %10.1f\n",
+		       name ? name + 1 : typical[i].name, c, d,
+		       d * packed.len / size);
+		/* Over all of them, as if one after another. */
+		typical_c += 1 / c;
+		typical_d += 1 / d;
+		free(packed.data);
+	}
+	typical_c = ntypical / typical_c;
+	typical_d = ntypical / typical_d;
+
+	for (i = 0; i < nencoder; ++i) {
+		in = encoder_cases[i]();
+		mbps = measure(&in, 0);
+		printf("%-38s %10.1f %10s %10s\n", in.name, mbps, "", "");
+		if (!worst_c_name || mbps < worst_c) {
+			worst_c = mbps;
+			worst_c_name = in.name;
+		}
+		free(in.data);
+	}
+	for (i = 0; i < ndecoder; ++i) {
+		in = decoder_cases[i]();
+		mbps = measure(&in, 1);
+		printf("%-38s %10s %10.1f %10.1f\n", in.name, "", mbps,
+		       mbps * in.len / size);
+		if (!worst_d_name || mbps < worst_d) {
+			worst_d = mbps;
+			worst_d_name = in.name;
+		}
+		free(in.data);
+	}
+
+	printf("\ncompress:   typical %.1f MB/s, worst %.1f MB/s (%.0f%%), "
+	       "%s\n", typical_c, worst_c, 100 * worst_c / typical_c,
+	       worst_c_name);
+	printf("decompress: typical %.1f MB/s, worst %.1f MB/s (%.0f%%), "
+	       "%s\n", typical_d, worst_d, 100 * worst_d / typical_d,
+	       worst_d_name);
+	for (i = 0; i < ntypical; ++i)
+		free(typical[i].data);
+	free(typical);
+	free(out);
+	free(wmem);
+	return 0;
+}
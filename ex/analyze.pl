@@ -0,0 +1,125 @@
+#!/usr/bin/env perl
+use strict;
+use warnings;
+
+use File::Spec;
+use Getopt::Long qw(GetOptions :config no_ignore_case);
+
+use Compress::Snappy qw(compress);
+
+# What compressed data is made of, through Compress::Snappy::analyze():
+# literals and copies of each kind, histograms of literal lengths, match
+# lengths and offsets, which of the decoder's paths the copies take, and
+# the ratio of each 32 KiB block. For files of compressed data, or with
+# --compress, of any data as compress() does it:
+#
+#   perl -Mblib ex/analyze.pl [options] file ...
+
+my %opts;
+GetOptions(\%opts, 'compress|c', 'mode|m=s', 'blocks|b', 'dump|d') && @ARGV
+    or die <<USAGE;
+usage: $0 [options] file ...
+
+--compress     compress the files first
+--mode MODE    with --compress, the mode: fast, dual, tagged or decode
+--blocks       print the ratio of every block, not just the extremes
+--dump         print every element
+USAGE
+
+for my $file (@ARGV) {
+    my $data = do {
+        open my $fh, '<:raw', $file or die "Cannot open $file: $!\n";
+        local $/;
+        <$fh>;
+    };
+    $data = compress($data, $opts{mode}) if $opts{compress};
+    my $name = (File::Spec->splitpath($file))[2];
+    print "$name:\n";
+    if ($opts{dump}) {
+        printf "%10s %10s  %-7s %6s %10s  %s\n", 'in', 'out', 'element',
+            'length', 'offset', 'path';
+    }
+    my $stats = Compress::Snappy::analyze($data,
+        $opts{dump} ? \&print_element : ());
+    if (!$stats) {
+        print "  not valid compressed data\n\n";
+        next;
+    }
+    report($stats);
+}
+
+exit;
+
+
+sub print_element {
+    my ($e) = @_;
+    printf "%10d %10d  %-7s %6d %10s  %s\n", $e->{in_pos}, $e->{out_pos},
+        $e->{tag}, $e->{length}, $e->{offset} // '', $e->{path} // '';
+}
+
+sub pct { $_[1] ? 100 * $_[0] / $_[1] : 0 }
+
+sub report {
+    my ($s) = @_;
+    my $elements = 0;
+    $elements += $_ for values %{ $s->{elements} };
+    printf "  %d bytes from %d, %.2f%%, in %d elements, %d matches\n\n",
+        $s->{uncompressed}, $s->{compressed},
+        pct($s->{compressed}, $s->{uncompressed}), $elements,
+        $s->{matches};
+
+    printf "  %-16s %10s %7s %12s %7s\n", 'element', 'count', '%', 'bytes',
+        '%';
+    for my $tag (qw(literal copy_1 copy_2 copy_4)) {
+        printf "  %-16s %10d %6.2f%% %12d %6.2f%%\n", $tag,
+            $s->{elements}{$tag}, pct($s->{elements}{$tag}, $elements),
+            $s->{bytes}{$tag}, pct($s->{bytes}{$tag}, $s->{uncompressed});
+    }
+
+    my $copies = $elements - $s->{elements}{literal};
+    printf "\n  %-16s %10s %7s\n", 'copy path', 'count', '%';
+    for my $path (qw(bulk bulk_pattern run fast incremental_fast
+            incremental)) {
+        printf "  %-16s %10d %6.2f%%\n", $path, $s->{paths}{$path},
+            pct($s->{paths}{$path}, $copies);
+    }
+
+    histogram('literal lengths', $s->{literal_lengths});
+    histogram('match lengths', $s->{match_lengths});
+    histogram('copy offsets', $s->{offsets});
+
+    my @blocks = @{ $s->{blocks} };
+    if ($opts{blocks}) {
+        print "\n  block          in        out   ratio\n";
+        printf "  %5d %10d %10d %6.2f%%\n", $_, @{ $blocks[$_] },
+            pct(@{ $blocks[$_] }) for 0 .. $#blocks;
+    }
+    elsif (@blocks) {
+        my @order = sort { pct(@{ $blocks[$a] }) <=> pct(@{ $blocks[$b] }) }
+            0 .. $#blocks;
+        printf "\n  %d blocks of 32 KiB: best %.2f%% (%d), median %.2f%%, "
+            . "worst %.2f%% (%d)\n", scalar @blocks,
+            pct(@{ $blocks[ $order[0] ] }), $order[0],
+            pct(@{ $blocks[ $order[ @order / 2 ] ] }),
+            pct(@{ $blocks[ $order[-1] ] }), $order[-1];
+    }
+    print "\n";
+}
+
+# Power of two buckets, as analyze() returns them.
+sub histogram {
+    my ($what, $buckets) = @_;
+    my ($total, $most, $first) = (0, 0);
+    for my $i (0 .. $#$buckets) {
+        $total += $buckets->[$i];
+        $most = $buckets->[$i] if $buckets->[$i] > $most;
+        $first //= $i if $buckets->[$i];
+    }
+    return unless $total;
+    printf "\n  %-16s %10s %7s\n", $what, 'count', '%';
+    for my $i ($first .. $#$buckets) {
+        my $range = $i ? sprintf('%d-%d', 2 ** $i, 2 ** ($i + 1) - 1) : 1;
+        printf "  %-16s %10d %6.2f%%  %s\n", $range, $buckets->[$i],
+            pct($buckets->[$i], $total), '#' x (40 * $buckets->[$i] / $most);
+    }
+}
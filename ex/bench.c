@@ -0,0 +1,584 @@
+/*
+Benchmark of csnappy_compress() and csnappy_decompress(), without the Perl
+layer in the way.
+
+Built on its own from the sources, from the top of the distribution:
+
+    cc -O2 -DHAVE_BUILTIN_CTZ -DHAVE_BUILTIN_CPU_SUPPORTS \
+        -o bench ex/bench.c -lm
+
+and run on a corpus directory, or files, or both:
+
+    ./bench [options] corpus/ [file ...]
+
+Options:
+    -n runs     timed runs per file and operation (10)
+    -t msecs    minimum length of a warm run (50)
+    -C          cold caches: flush input, output and working memory before
+                every call, and time calls one at a time
+    -c cpu      pin to this CPU
+    -k kernels  use these kernels, as named by csnappy_kernels_available()
+    -d decoder  decompress with csnappy_decompress_noheader_twophase()
+                instead, given "twophase"
+    -m mode     compressor mode: fast, dual, tagged or decode
+    -L          time every call on its own instead, see below
+    -H          with -L, also print histograms
+
+Reports per file the ratio, then for each direction the speed in MB/s of
+uncompressed data (mean over runs), its run to run standard deviation and
+the time stamp counter cycles per byte, where there is one.
+
+With -L, the files are taken as one stream, cut into payloads of 32 bytes
+to 1 MiB, and each call is timed alone, for the percentiles of their
+latency per payload size; ex/latency.pl does the same through the Perl
+functions. Calls are timed with the time stamp counter where there is one,
+and clock_gettime() elsewhere.
+*/
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/csnappy_compress.c"
+#include "../src/csnappy_decompress.c"
+#include "../src/csnappy_dispatch.c"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+struct file {
+	char *name;
+	char *data;
+	uint32_t len;
+};
+
+struct stats {
+	double mbps, sd, cpb;
+};
+
+static int runs = 10;
+static double min_time = 0.05;
+static int cold;
+static int histograms;
+static int mode = CSNAPPY_MODE_FAST;
+static int twophase;
+
+static struct file *files;
+static int nfiles, maxfiles;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t cycles(void)
+{
+#if defined(HAVE_RDTSC)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+static void die(const char *what, const char *name)
+{
+	fprintf(stderr, "bench: %s %s: %s\n", what, name, strerror(errno));
+	exit(1);
+}
+
+static void add_file(const char *name)
+{
+	struct file *f;
+	FILE *fp;
+	long len;
+
+	if (nfiles == maxfiles) {
+		maxfiles = maxfiles ? 2 * maxfiles : 16;
+		files = realloc(files, maxfiles * sizeof(*files));
+	}
+	f = &files[nfiles];
+	if (!(fp = fopen(name, "rb")))
+		die("cannot open", name);
+	fseek(fp, 0, SEEK_END);
+	len = ftell(fp);
+	rewind(fp);
+	if (len <= 0 || len > 0x7fffffff) {
+		fclose(fp);
+		return;
+	}
+	f->name = strdup(name);
+	f->data = malloc(len);
+	f->len = len;
+	if (fread(f->data, 1, len, fp) != (size_t)len)
+		die("cannot read", name);
+	fclose(fp);
+	nfiles++;
+}
+
+static int by_name(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static void add_path(const char *path)
+{
+	struct stat st;
+	struct dirent *de;
+	DIR *dir;
+	char **names = NULL;
+	int n = 0, max = 0, i;
+
+	if (stat(path, &st))
+		die("cannot stat", path);
+	if (!S_ISDIR(st.st_mode)) {
+		add_file(path);
+		return;
+	}
+	if (!(dir = opendir(path)))
+		die("cannot open", path);
+	while ((de = readdir(dir))) {
+		char *name;
+		if (de->d_name[0] == '.')
+			continue;
+		name = malloc(strlen(path) + strlen(de->d_name) + 2);
+		sprintf(name, "%s/%s", path, de->d_name);
+		if (stat(name, &st) || !S_ISREG(st.st_mode)) {
+			free(name);
+			continue;
+		}
+		if (n == max) {
+			max = max ? 2 * max : 16;
+			names = realloc(names, max * sizeof(*names));
+		}
+		names[n++] = name;
+	}
+	closedir(dir);
+	qsort(names, n, sizeof(*names), by_name);
+	for (i = 0; i < n; i++) {
+		add_file(names[i]);
+		free(names[i]);
+	}
+	free(names);
+}
+
+/* Pushes a buffer out of every level of cache. */
+static void flush(const char *p, size_t len)
+{
+#if defined(CSNAPPY_HAVE_SSE2)
+	size_t i;
+	for (i = 0; i < len; i += 64)
+		_mm_clflush(p + i);
+	_mm_clflush(p + len - 1);
+	_mm_mfence();
+#else
+	/* Without clflush, by reading something much larger than the LLC. */
+	static char *big;
+	static const size_t big_len = 256 << 20;
+	volatile char sink;
+	size_t i;
+	(void)p;
+	(void)len;
+	if (!big)
+		big = calloc(big_len, 1);
+	for (i = 0; i < big_len; i += 64)
+		sink = big[i];
+	(void)sink;
+#endif
+}
+
+/* csnappy_decompress(), through the decoder chosen with -d. */
+static int decompress(const char *in, uint32_t in_len, char *out,
+		      uint32_t out_len)
+{
+	uint32_t len;
+	int n;
+	if (!twophase)
+		return csnappy_decompress(in, in_len, out, out_len);
+	n = csnappy_get_uncompressed_length(in, in_len, &len);
+	if (n < CSNAPPY_E_OK)
+		return n;
+	if (len > out_len)
+		return CSNAPPY_E_OUTPUT_INSUF;
+	return csnappy_decompress_noheader_twophase(in + n, in_len - n, out,
+						    &len);
+}
+
+static char *src, *dst, *wmem;
+static uint32_t src_len, dst_len;
+static int decompressing;
+
+static void once(void)
+{
+	if (decompressing) {
+		if (decompress(src, src_len, dst, dst_len) != CSNAPPY_E_OK) {
+			fprintf(stderr, "bench: decompression failed\n");
+			exit(1);
+		}
+	} else {
+		uint32_t len;
+		csnappy_compress_mode(src, src_len, dst, &len, wmem,
+				      CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO, mode);
+	}
+}
+
+/*
+ * Times the current operation over len bytes of uncompressed data: warm,
+ * repeated for at least min_time per run, or cold, one call per run.
+ */
+static struct stats measure(uint32_t len)
+{
+	struct stats s;
+	double t, sum = 0, sum2 = 0, *mbps = malloc(runs * sizeof(double));
+	uint64_t c, best_c = ~(uint64_t)0;
+	long reps = 1, i;
+	int r;
+
+	if (!cold) {
+		once();
+		t = now();
+		while ((t = now() - t) < min_time / 4) {
+			reps *= 2;
+			t = now();
+			for (i = 0; i < reps; i++)
+				once();
+		}
+		reps = reps * (min_time / t) + 1;
+	}
+	for (r = 0; r < runs; r++) {
+		if (cold) {
+			flush(src, src_len);
+			flush(dst, dst_len);
+			flush(wmem, CSNAPPY_MODE_WORKMEM_BYTES(
+				CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO));
+		}
+		t = now();
+		c = cycles();
+		for (i = 0; i < reps; i++)
+			once();
+		c = cycles() - c;
+		t = now() - t;
+		if (c < best_c)
+			best_c = c;
+		mbps[r] = (double)len * reps / t / 1e6;
+		sum += mbps[r];
+	}
+	s.mbps = sum / runs;
+	for (r = 0; r < runs; r++)
+		sum2 += (mbps[r] - s.mbps) * (mbps[r] - s.mbps);
+	s.sd = runs > 1 ? sqrt(sum2 / (runs - 1)) : 0;
+	s.cpb = (double)best_c / reps / len;
+	free(mbps);
+	return s;
+}
+
+static void print_stats(struct stats s)
+{
+	printf("  %9.1f %5.1f%%", s.mbps, s.mbps ? 100 * s.sd / s.mbps : 0);
+#if defined(HAVE_RDTSC)
+	printf(" %6.2f", s.cpb);
+#else
+	printf(" %6s", "-");
+#endif
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: bench [-C] [-n runs] [-t msecs] [-c cpu] "
+		"[-k kernels] [-d decoder] [-m mode] [-L [-H]] path ...\n");
+	exit(2);
+}
+
+static void throughput_table(void)
+{
+	uint64_t total_in = 0, total_out = 0;
+	double total_ct = 0, total_dt = 0;
+	char *comp;
+	int i;
+
+	printf("kernels %s%s, %s caches, %d runs\n", csnappy_kernels_name(),
+	       twophase ? ", two phase decoder" : "", cold ? "cold" : "warm",
+	       runs);
+	printf("%-24s %10s %7s  %9s %6s %6s  %9s %6s %6s\n", "file", "bytes",
+	       "ratio", "comp MB/s", "+-", "c/B", "dec MB/s", "+-", "c/B");
+	for (i = 0; i < nfiles; i++) {
+		struct file *f = &files[i];
+		const char *name = strrchr(f->name, '/');
+		struct stats cs, ds;
+		uint32_t comp_len;
+		char *out;
+
+		comp = malloc(csnappy_max_compressed_length(f->len));
+		out = malloc(f->len);
+		csnappy_compress_mode(f->data, f->len, comp, &comp_len, wmem,
+				      CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO, mode);
+		if (decompress(comp, comp_len, out, f->len) != CSNAPPY_E_OK ||
+		    memcmp(out, f->data, f->len)) {
+			fprintf(stderr, "bench: %s does not round trip\n",
+				f->name);
+			exit(1);
+		}
+
+		src = f->data, src_len = f->len;
+		dst = comp, dst_len = csnappy_max_compressed_length(f->len);
+		decompressing = 0;
+		cs = measure(f->len);
+		src = comp, src_len = comp_len;
+		dst = out, dst_len = f->len;
+		decompressing = 1;
+		ds = measure(f->len);
+
+		printf("%-24.24s %10u %6.2f%%", name ? name + 1 : f->name,
+		       f->len, 100.0 * comp_len / f->len);
+		print_stats(cs);
+		print_stats(ds);
+		printf("\n");
+
+		total_in += f->len;
+		total_out += comp_len;
+		total_ct += f->len / cs.mbps;
+		total_dt += f->len / ds.mbps;
+		free(comp);
+		free(out);
+	}
+	printf("%-24s %10llu %6.2f%%  %9.1f %6s %6s  %9.1f\n", "total",
+	       (unsigned long long)total_in, 100.0 * total_out / total_in,
+	       total_in / total_ct, "", "", total_in / total_dt);
+}
+
+/*
+ * Ticks of the clock the latency of single calls is taken with, and how
+ * many nanoseconds one is.
+ */
+static double ns_per_tick = 1;
+
+static uint64_t ticks(void)
+{
+#if defined(HAVE_RDTSC)
+	_mm_lfence();
+	return __rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static void calibrate(void)
+{
+#if defined(HAVE_RDTSC)
+	double t = now();
+	uint64_t c = ticks();
+	while (now() - t < 0.1)
+		;
+	ns_per_tick = (now() - t) * 1e9 / (ticks() - c);
+#endif
+}
+
+static int by_value(const void *a, const void *b)
+{
+	const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/* Sorts the samples and prints their percentiles, in ns. */
+static void percentiles(uint64_t *t, long n)
+{
+	static const double pct[] = { 50, 90, 99, 99.9 };
+	unsigned i;
+
+	qsort(t, n, sizeof(*t), by_value);
+	for (i = 0; i < sizeof(pct) / sizeof(pct[0]); ++i)
+		printf(" %8.0f", t[(long)(n * pct[i] / 100)] * ns_per_tick);
+	printf(" %8.0f", t[n - 1] * ns_per_tick);
+}
+
+/* Of sorted samples, in power of two buckets of ns. */
+static void histogram(const char *what, uint32_t size, const uint64_t *t,
+		      long n)
+{
+	long i = 0, count, most = 0, counts[64] = { 0 };
+	int b, first = 63, last = 0;
+
+	for (i = 0; i < n; ++i) {
+		double ns = t[i] * ns_per_tick;
+		for (b = 0; b < 63 && ns >= 2 << b; ++b)
+			;
+		if (++counts[b] > most)
+			most = counts[b];
+		if (b < first)
+			first = b;
+		if (b > last)
+			last = b;
+	}
+	printf("\n%s, %u bytes:\n", what, size);
+	for (b = first; b <= last; ++b) {
+		count = counts[b];
+		printf("  < %10.0f ns %8ld  ", (double)(2ull << b), count);
+		for (i = 0; i < 50 * count / most; ++i)
+			putchar('#');
+		putchar('\n');
+	}
+}
+
+/*
+ * Times calls one at a time, on payloads of each size cut from all the
+ * files at once, a few different ones in turn.
+ */
+static void latency_table(void)
+{
+	uint64_t *ct, *dt;
+	uint32_t total = 0, size, max_comp, comp_len[64];
+	char *all, *comp, *out;
+	long calls, i;
+	int k, slices, f, n;
+
+	/* As many as fit in 1 GiB. */
+	for (n = 0; n < nfiles && files[n].len <= (1u << 30) - total; n++)
+		total += files[n].len;
+	all = malloc(total);
+	for (total = 0, f = 0; f < n; f++) {
+		memcpy(all + total, files[f].data, files[f].len);
+		total += files[f].len;
+	}
+	calibrate();
+
+	printf("kernels %s%s, ns per call\n", csnappy_kernels_name(),
+	       twophase ? ", two phase decoder" : "");
+	printf("%8s %7s  %-44s  %s\n", "", "", "compress", "decompress");
+	printf("%8s %7s  %8s %8s %8s %8s %8s  %8s %8s %8s %8s %8s\n",
+	       "bytes", "calls", "p50", "p90", "p99", "p99.9", "max",
+	       "p50", "p90", "p99", "p99.9", "max");
+	for (size = 32; size <= 1 << 20 && size <= total; size *= 2) {
+		/* Enough for the 99.9th percentile, in reasonable time. */
+		calls = (64 << 20) / size;
+		calls = calls < 1000 ? 1000 : calls > 100000 ? 100000 : calls;
+		slices = (16 << 20) / size;
+		slices = slices < 4 ? 4 : slices > 64 ? 64 : slices;
+		max_comp = csnappy_max_compressed_length(size);
+		comp = malloc((size_t)slices * max_comp);
+		out = malloc(size);
+		ct = malloc(calls * sizeof(*ct));
+		dt = malloc(calls * sizeof(*dt));
+
+		for (i = 0; i < calls; i++) {
+			const char *in;
+			uint64_t t;
+			k = i % slices;
+			in = all + (total - size) / slices * k;
+			t = ticks();
+			csnappy_compress_mode(in, size, comp + k * max_comp,
+					      &comp_len[k], wmem,
+					      CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO,
+					      mode);
+			ct[i] = ticks() - t;
+		}
+		for (i = 0; i < calls; i++) {
+			uint64_t t;
+			k = i % slices;
+			t = ticks();
+			if (decompress(comp + k * max_comp, comp_len[k], out,
+				       size) != CSNAPPY_E_OK) {
+				fprintf(stderr, "bench: decompression failed\n");
+				exit(1);
+			}
+			dt[i] = ticks() - t;
+		}
+		printf("%8u %7ld ", size, calls);
+		percentiles(ct, calls);
+		printf(" ");
+		percentiles(dt, calls);
+		printf("\n");
+		if (histograms) {
+			histogram("compress", size, ct, calls);
+			histogram("decompress", size, dt, calls);
+			printf("\n");
+		}
+		free(comp);
+		free(out);
+		free(ct);
+		free(dt);
+	}
+	free(all);
+}
+
+int main(int argc, char **argv)
+{
+	int opt, i, cpu = -1, latency = 0;
+	const char *kernels = NULL;
+
+	while ((opt = getopt(argc, argv, "Cn:t:c:k:d:m:LH")) != -1) {
+		switch (opt) {
+		case 'C': cold = 1; break;
+		case 'n': runs = atoi(optarg); break;
+		case 't': min_time = atof(optarg) / 1000; break;
+		case 'c': cpu = atoi(optarg); break;
+		case 'k': kernels = optarg; break;
+		case 'd':
+			if (strcmp(optarg, "twophase"))
+				usage();
+			twophase = 1;
+			break;
+		case 'L': latency = 1; break;
+		case 'H': histograms = 1; break;
+		case 'm':
+			if (!strcmp(optarg, "fast"))
+				mode = CSNAPPY_MODE_FAST;
+			else if (!strcmp(optarg, "dual"))
+				mode = CSNAPPY_MODE_DUAL_HASH;
+			else if (!strcmp(optarg, "tagged"))
+				mode = CSNAPPY_MODE_TAGGED;
+			else if (!strcmp(optarg, "decode"))
+				mode = CSNAPPY_MODE_DECODE_FAST;
+			else
+				usage();
+			break;
+		default: usage();
+		}
+	}
+	if (optind == argc || runs < 1)
+		usage();
+	for (i = optind; i < argc; i++)
+		add_path(argv[i]);
+	if (!nfiles) {
+		fprintf(stderr, "bench: no files\n");
+		return 1;
+	}
+#if defined(__linux__)
+	if (cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set))
+			die("cannot pin to", "CPU");
+	}
+#else
+	if (cpu >= 0)
+		fprintf(stderr, "bench: no CPU pinning here, ignoring -c\n");
+#endif
+	if (csnappy_select_kernels(kernels) != CSNAPPY_E_OK) {
+		fprintf(stderr, "bench: kernels %s not supported\n", kernels);
+		return 1;
+	}
+	if (posix_memalign((void **)&wmem, CSNAPPY_WORKMEM_ALIGN,
+			   CSNAPPY_MODE_WORKMEM_BYTES(
+				   CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO)))
+		return 1;
+
+	if (latency)
+		latency_table();
+	else
+		throughput_table();
+	return 0;
+}
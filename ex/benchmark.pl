@@ -6,118 +6,283 @@ use Benchmark qw(timethese);
 use Getopt::Long qw(GetOptions :config no_ignore_case);
 use List::Util qw(max);
 
-use Compress::Bzip2  ();
-use Compress::LZ4    ();
-use Compress::LZF    ();
 use Compress::Snappy ();
-use Compress::Zlib   ();
 
-my %opts = (
-    iterations => -1,
-    size       => 10,  # kB
+# Other codecs to compare against, where installed.
+my %codecs = (
+    'Compress::Bzip2'  => [qw(compress decompress)],
+    'Compress::LZ4'    => [qw(compress decompress)],
+    'Compress::LZF'    => [qw(compress decompress)],
+    'Compress::Snappy' => [qw(compress decompress)],
+    'Compress::Zlib'   => [qw(compress uncompress)],
 );
-GetOptions(\%opts, 'iterations|i=i', 'size|s=f',);
-
-my $data = join '', ('A'..'Z', 'a'..'z', 0..9, qw(_ .)) x (16 * $opts{size});
 
-my %compress = (
-    'Compress::Bzip2::compress'  => sub { Compress::Bzip2::compress($data) },
-    'Compress::LZ4::compress'    => sub { Compress::LZ4::compress($data) },
-    'Compress::LZF::compress'    => sub { Compress::LZF::compress($data) },
-    'Compress::Snappy::compress' => sub { Compress::Snappy::compress($data) },
-    'Compress::Zlib::compress'   => sub { Compress::Zlib::compress($data) },
+# Data that looks like what gets compressed in practice, by name.
+my %profiles = (
+    text       => \&text,
+    json       => \&json_log,
+    csv        => \&csv,
+    proto      => \&proto,
+    numeric    => \&numeric,
+    html       => \&html,
+    compressed => \&compressed,
+    random     => \&random,
 );
 
-my $bzip2  = Compress::Bzip2::compress($data);
-my $lz4    = Compress::LZ4::compress($data);
-my $lzf    = Compress::LZF::compress($data);
-my $snappy = Compress::Snappy::compress($data);
-my $zlib   = Compress::Zlib::compress($data);
-
-my %compression_ratios = (
-    'Compress::Bzip2::compress'  => length($bzip2) / length($data),
-    'Compress::LZ4::compress'    => length($lz4) / length($data),
-    'Compress::LZF::compress'    => length($lzf) / length($data),
-    'Compress::Snappy::compress' => length($snappy) / length($data),
-    'Compress::Zlib::compress'   => length($zlib) / length($data),
+my %opts = (
+    iterations => -1,
+    size       => [],
+    profile    => [],
+    codec      => [],
+    seed       => 42,
 );
+GetOptions(\%opts, 'iterations|i=i', 'size|s=s@', 'profile|p=s@',
+    'codec|c=s@', 'json|j', 'seed=i',
+) or die <<USAGE;
+usage: $0 [--iterations N] [--size SIZE ...] [--profile NAME ...]
+       [--codec MODULE ...] [--json] [--seed N]
 
-my %decompress = (
-    'Compress::Bzip2::decompress' =>
-        sub { Compress::Bzip2::decompress($bzip2) },
-    'Compress::LZ4::decompress' => sub { Compress::LZ4::decompress($lz4) },
-    'Compress::LZF::decompress' => sub { Compress::LZF::decompress($lzf) },
-    'Compress::Snappy::decompress' =>
-        sub { Compress::Snappy::decompress($snappy) },
-    'Compress::Zlib::uncompress' => sub { Compress::Zlib::uncompress($zlib) },
-);
+--iterations is passed to Benchmark's timethese(): a count of calls, or
+if negative, the CPU seconds to run each for (the default, -1). Sizes take
+a b, k or m suffix, and are in KiB without one; by default 64 bytes to
+64 MiB, in steps of 16. Profiles: @{[ join ', ', sort keys %profiles ]}.
+USAGE
 
-run(\%compress, 'Compressible', 'compression', \%compression_ratios);
-print "\n";
-run(\%decompress, 'Compressible', 'decompression');
-print "\n";
-
-# Make a string of random bytes.
-$data = join '', map { chr int rand(256) } (1 .. $opts{size});
-# Compress it just to make sure.
-$data = Compress::Bzip2::compress($data);
-
-$bzip2  = Compress::Bzip2::compress($data);
-$lz4    = Compress::LZ4::compress($data);
-$lzf    = Compress::LZF::compress($data);
-$snappy = Compress::Snappy::compress($data);
-$zlib   = Compress::Zlib::compress($data);
-
-%compression_ratios = (
-    'Compress::Bzip2::compress'  => length($bzip2) / length($data),
-    'Compress::LZ4::compress'    => length($lz4) / length($data),
-    'Compress::LZF::compress'    => length($lzf) / length($data),
-    'Compress::Snappy::compress' => length($snappy) / length($data),
-    'Compress::Zlib::compress'   => length($zlib) / length($data),
-);
+my @sizes = @{ $opts{size} }
+    ? map { parse_size($_) } map { split /,/ } @{ $opts{size} }
+    : map { 64 * 16 ** $_ } 0 .. 5;
+my @profiles = @{ $opts{profile} } ? map { split /,/ } @{ $opts{profile} }
+    : sort keys %profiles;
+for (@profiles) { die "Unknown profile: $_\n" unless $profiles{$_} }
+
+my @codecs;
+for my $module (@{ $opts{codec} } ? map { split /,/ } @{ $opts{codec} }
+        : sort keys %codecs) {
+    die "Unknown codec: $module\n" unless $codecs{$module};
+    if (eval "require $module; 1") {
+        push @codecs, $module;
+    }
+    else {
+        warn "Skipping $module, not installed\n";
+    }
+}
 
-run(\%compress, 'Uncompressible', 'compression', \%compression_ratios);
-print "\n";
-run(\%decompress, 'Uncompressible', 'decompression');
+my @results;
+for my $profile (@profiles) {
+    srand $opts{seed};
+    my $all = $profiles{$profile}->(max @sizes);
+    for my $size (@sizes) {
+        my $data = substr $all, 0, $size;
+        my (%compress, %decompress, %ratio);
+        for my $module (@codecs) {
+            my ($c, $d) = map { \&{"${module}::$_"} } @{ $codecs{$module} };
+            my $packed = $c->($data);
+            die "$module does not round trip $profile data\n"
+                unless $d->($packed) eq $data;
+            $compress{"${module}::$codecs{$module}[0]"}
+                = sub { $c->($data) };
+            $decompress{"${module}::$codecs{$module}[1]"}
+                = sub { $d->($packed) };
+            $ratio{$module} = length($packed) / $size;
+        }
+        push @results,
+            run(\%compress, $profile, $size, 'compression', \%ratio),
+            run(\%decompress, $profile, $size, 'decompression', \%ratio);
+    }
+}
+
+if ($opts{json}) {
+    require JSON::PP;
+    print JSON::PP->new->canonical->pretty->encode(\@results);
+}
 
 exit;
 
 
+sub parse_size {
+    my ($size) = @_;
+    my ($n, $unit) = $size =~ /^(\d+(?:\.\d+)?)([bkm]?)$/i
+        or die "Bad size: $size\n";
+    return int $n * { b => 1, k => 1024, m => 1024 ** 2, '' => 1024 }
+        ->{lc $unit};
+}
+
+sub human_size {
+    my ($size) = @_;
+    return $size % 1024 ** 2 ? $size % 1024 ? "$size bytes"
+        : $size / 1024 . ' KiB' : $size / 1024 ** 2 . ' MiB';
+}
+
 sub run {
-    my ($tests, $type, $op, $c_ratios) = @_;
+    my ($tests, $profile, $size, $op, $ratios) = @_;
 
-    my $header = sprintf '%s data (%s KiB) - %s', $type, $opts{size}, $op;
-    printf "%s\n%s\n", $header, '-' x length($header);
+    my $header = sprintf '%s data (%s) - %s', $profile, human_size($size),
+        $op;
+    printf "%s\n%s\n", $header, '-' x length($header) unless $opts{json};
 
-    my $times = timethese -1, $tests, 'none';
+    # Benchmark prints its warnings, keep them out of the JSON.
+    my $stdout = select;
+    select STDERR if $opts{json};
+    my $times = timethese $opts{iterations}, $tests, 'none';
+    select $stdout;
 
     my @info;
     my ($max_name_len, $max_rate_len, $max_bw_len) = (0, 0, 0);
-    my ($c_format, $c_ratio_sub) = ('', sub { });
-    if ($c_ratios) {
-        $c_format    = '  %.3f%%';
-        $c_ratio_sub = sub { 100 * $c_ratios->{$_[0]} };
-    }
 
     while (my ($name, $info) = each %$times) {
-        my ($duration, $cycles) = @{$info}[ 1, 5 ];
-        my $rate = sprintf '%.0f', $cycles / $duration;
-        my $bw = $rate * $opts{size} / 1024;
-        $bw = sprintf int $bw ? '%.0f' : '%.2f', $bw;
+        # Too few iterations can take no measurable CPU time at all.
+        my ($duration, $cycles) = ($info->[1] + $info->[2], $info->[5]);
+        my ($rate, $bw) = ('-', '-');
+        if ($duration > 0) {
+            $rate = sprintf '%.0f', $cycles / $duration;
+            $bw = $rate * $size / 1024 ** 2;
+            $bw = sprintf int $bw ? '%.0f' : '%.2f', $bw;
+        }
+        (my $module = $name) =~ s/::\w+$//;
 
-        push @info, [$name, $rate, $bw];
+        push @info, {
+            profile    => $profile,
+            size       => $size,
+            op         => $op,
+            name       => $name,
+            iterations => $cycles,
+            seconds    => $duration,
+            rate       => $rate,
+            mib_per_s  => $bw,
+            ratio      => $ratios->{$module},
+        };
 
         $max_name_len = max $max_name_len, length($name);
         $max_rate_len = max $max_rate_len, length($rate);
         $max_bw_len   = max $max_bw_len,   length($bw);
     }
 
-    for my $rec (sort { $b->[1] <=> $a->[1] } @info) {
-        my ($name, $rate, $bw) = @$rec;
+    @info = sort { ($b->{rate} eq '-' ? 0 : $b->{rate})
+        <=> ($a->{rate} eq '-' ? 0 : $a->{rate}) } @info;
+    if ($opts{json}) {
+        for my $rec (@info) {
+            $_ = $_ eq '-' ? undef : 0 + $_ for @{$rec}{qw(rate mib_per_s)};
+        }
+        return @info;
+    }
+
+    for my $rec (@info) {
+        my $name_padding = $max_name_len - length($rec->{name});
+        printf "%s %s %${max_rate_len}s/s  %${max_bw_len}s MiB/s",
+            $rec->{name}, ' 'x$name_padding, $rec->{rate}, $rec->{mib_per_s};
+        printf '  %.3f%%', 100 * $rec->{ratio} if $op eq 'compression';
+        print "\n";
+    }
+    print "\n";
+    return @info;
+}
+
+# Each generator returns at least $len bytes of its kind of data.
+
+sub pick { $_[ rand @_ ] }
+
+sub text {
+    my ($len) = @_;
+    my $chunk = join '', ('A'..'Z', 'a'..'z', 0..9, qw(_ .)) x 16;
+    return $chunk x (1 + $len / length $chunk);
+}
+
+sub json_log {
+    my ($len) = @_;
+    my @paths = map { "/api/v1/$_" } qw(items users orders search cart login);
+    my @agents = ('Mozilla/5.0 (X11; Linux x86_64)', 'curl/7.35.0',
+        'Mozilla/5.0 (Windows NT 6.1; WOW64)', 'python-requests/2.2.1');
+    my ($out, $t) = ('', 1391831775);
+    while (length $out < $len) {
+        $t += int rand 3;
+        my @tm = gmtime $t;
+        $out .= sprintf '{"ts":"%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",'
+            . '"level":"%s","host":"web%02d","method":"%s","path":"%s/%d",'
+            . '"status":%d,"ms":%.1f,"bytes":%d,"ua":"%s"}' . "\n",
+            $tm[5] + 1900, $tm[4] + 1, @tm[3, 2, 1, 0], rand 1000,
+            pick(qw(info info info warn error)), rand 32, pick(qw(GET POST)),
+            pick(@paths), rand 100_000, pick(200, 200, 200, 304, 404, 500),
+            rand 250, rand 50_000, pick(@agents);
+    }
+    return $out;
+}
+
+sub csv {
+    my ($len) = @_;
+    my @names = qw(alice bob carol dave erin frank grace heidi ivan judy);
+    my ($out, $id) = ("id,date,name,city,quantity,price,total\n", 0);
+    while (length $out < $len) {
+        my ($q, $p) = (1 + int rand 20, rand 100);
+        $out .= sprintf "%d,2014-%02d-%02d,%s,%s,%d,%.2f,%.2f\n", ++$id,
+            1 + rand 12, 1 + rand 28, pick(@names),
+            pick(qw(London Paris Berlin Tokyo Austin)), $q, $p, $q * $p;
+    }
+    return $out;
+}
+
+# Protocol buffer like records: varint keys, lengths and values.
+sub proto {
+    my ($len) = @_;
+    my $varint = sub {
+        my ($n, $s) = (shift, '');
+        while ($n >= 0x80) { $s .= chr(0x80 | $n & 0x7f); $n >>= 7 }
+        return $s . chr $n;
+    };
+    my ($out, $id) = ('', 1_000_000);
+    while (length $out < $len) {
+        my $name = join '', map { pick('a'..'z') } 1 .. 4 + rand 12;
+        my $record = "\x08" . $varint->($id += 1 + int rand 10)
+            . "\x12" . chr(length $name) . $name
+            . "\x18" . $varint->(int rand 2 ** 20)
+            . "\x21" . pack('d<', rand 1000)
+            . "\x28" . chr(int rand 2);
+        $out .= $varint->(length $record) . $record;
+    }
+    return $out;
+}
 
-        my $name_padding = $max_name_len - length($name);
+# Little endian 32 bit integers and doubles, as random walks.
+sub numeric {
+    my ($len) = @_;
+    my ($out, $i, $d) = ('', 0, 100);
+    while (length $out < $len) {
+        $out .= pack 'l<*', map { $i += int(rand 200) - 100 } 1 .. 1024;
+        $out .= pack 'd<*', map { $d *= 1 + (rand() - 0.5) / 100 } 1 .. 512;
+    }
+    return $out;
+}
 
-        printf "%s %s %${max_rate_len}s/s  %${max_bw_len}s MiB/s$c_format\n",
-            $name, ' 'x$name_padding, $rate, $bw, $c_ratio_sub->($name);
+sub html {
+    my ($len) = @_;
+    my @words = qw(lorem ipsum dolor sit amet consectetur adipiscing elit
+        sed do eiusmod tempor incididunt ut labore et dolore magna aliqua);
+    my $out = "<!DOCTYPE html>\n<html><head><title>Index</title></head>\n"
+        . "<body>\n<table class=\"list\">\n";
+    while (length $out < $len) {
+        my $id = int rand 100_000;
+        $out .= qq(<tr class="row"><td class="id"><a href="/item/$id">$id)
+            . qq(</a></td><td class="text">)
+            . join(' ', map { pick(@words) } 1 .. 3 + rand 10)
+            . qq(</td><td class="price">\$) . sprintf('%.2f', rand 100)
+            . "</td></tr>\n";
     }
+    return $out;
+}
+
+# Already compressed data, such as images or archives.
+sub compressed {
+    my ($len) = @_;
+    require Compress::Zlib;
+    my ($log, $out) = (json_log(1 << 20), '');
+    while (length $out < $len) {
+        my $at = int rand length $log;
+        $out .= Compress::Zlib::compress(substr($log, $at) . substr($log, 0,
+            $at));
+    }
+    return $out;
+}
+
+sub random {
+    my ($len) = @_;
+    return join '', map { pack 'L', rand 2 ** 32 } 0 .. $len / 4;
 }
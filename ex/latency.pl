@@ -0,0 +1,98 @@
+#!/usr/bin/env perl
+use strict;
+use warnings;
+
+use Getopt::Long qw(GetOptions :config no_ignore_case);
+use Time::HiRes qw(clock_gettime CLOCK_MONOTONIC);
+
+use Compress::Snappy qw(compress decompress);
+
+# Latency of single calls to compress() and decompress(), by payload size,
+# as ex/bench.c -L has it for the C functions: the difference between the
+# two is what the Perl and XS layers add to each call.
+
+my %opts = (histograms => 0);
+GetOptions(\%opts, 'histograms|H') && @ARGV
+    or die "usage: $0 [--histograms] file ...\n";
+
+my $all = '';
+for my $file (@ARGV) {
+    open my $fh, '<:raw', $file or die "Cannot open $file: $!\n";
+    local $/;
+    $all .= <$fh>;
+}
+
+# Two clock reads, around nothing, and around the least work an XS call
+# can do.
+my @timer = time_calls(100_000, sub { });
+my @empty = time_calls(100_000, sub { compress('') });
+
+printf "ns per call, timer %.0f, empty compress() %.0f at the median\n",
+    (sort { $a <=> $b } @timer)[ @timer / 2 ],
+    (sort { $a <=> $b } @empty)[ @empty / 2 ];
+printf "%8s %7s  %-44s  %s\n", '', '', 'compress', 'decompress';
+printf "%8s %7s  %8s %8s %8s %8s %8s  %8s %8s %8s %8s %8s\n",
+    'bytes', 'calls', ('p50', 'p90', 'p99', 'p99.9', 'max') x 2;
+
+for (my $size = 32; $size <= 1 << 20 && $size <= length $all; $size *= 2) {
+    # Enough for the 99.9th percentile, in reasonable time.
+    my $calls = (64 << 20) / $size;
+    $calls = $calls < 1000 ? 1000 : $calls > 100_000 ? 100_000 : $calls;
+    my $slices = (16 << 20) / $size;
+    $slices = $slices < 4 ? 4 : $slices > 64 ? 64 : int $slices;
+    my @in = map { substr $all, int((length($all) - $size) / $slices) * $_,
+        $size } 0 .. $slices - 1;
+    my @packed = map { compress($_) } @in;
+
+    my $k = 0;
+    my @ct = time_calls($calls, sub { compress($in[ $k++ % $slices ]) });
+    $k = 0;
+    my @dt = time_calls($calls,
+        sub { decompress($packed[ $k++ % $slices ]) });
+    printf "%8d %7d  %s  %s\n", $size, $calls, percentiles(\@ct),
+        percentiles(\@dt);
+    if ($opts{histograms}) {
+        histogram("compress, $size bytes", \@ct);
+        histogram("decompress, $size bytes", \@dt);
+        print "\n";
+    }
+}
+
+exit;
+
+
+# Nanoseconds each of $calls calls to $sub took, sorted.
+sub time_calls {
+    my ($calls, $sub) = @_;
+    my @t;
+    for (1 .. $calls) {
+        my $t = clock_gettime(CLOCK_MONOTONIC);
+        $sub->();
+        push @t, 1e9 * (clock_gettime(CLOCK_MONOTONIC) - $t);
+    }
+    return sort { $a <=> $b } @t;
+}
+
+sub percentiles {
+    my ($t) = @_;
+    return join ' ', map { sprintf '%8.0f', $_ }
+        (map { $t->[ @$t * $_ / 100 ] } 50, 90, 99, 99.9), $t->[-1];
+}
+
+# In power of two buckets of ns.
+sub histogram {
+    my ($what, $t) = @_;
+    my %count;
+    for (@$t) {
+        my $b = 1;
+        $b *= 2 while $b <= $_;
+        $count{$b}++;
+    }
+    my ($most) = sort { $b <=> $a } values %count;
+    my @buckets = sort { $a <=> $b } keys %count;
+    print "\n$what:\n";
+    for (my $b = $buckets[0]; $b <= $buckets[-1]; $b *= 2) {
+        my $n = $count{$b} || 0;
+        printf "  < %10d ns %8d  %s\n", $b, $n, '#' x (50 * $n / $most);
+    }
+}
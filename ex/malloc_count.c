@@ -0,0 +1,125 @@
+/*
+Counts the calls to malloc() and friends of the process it is preloaded
+into, for ex/memory.pl, which finds malloc_count with DynaLoader and reads
+it before and after each operation. Build and use it with:
+
+    cc -O2 -shared -fPIC -o malloc_count.so ex/malloc_count.c -ldl
+    LD_PRELOAD=./malloc_count.so perl -Mblib ex/memory.pl file ...
+
+For glibc; sizes are as malloc_usable_size() reports them.
+*/
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <malloc.h>
+#include <stddef.h>
+#include <string.h>
+
+/* Allocations, bytes allocated, bytes in use, most bytes in use. */
+unsigned long long malloc_count[4];
+
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+
+/* dlsym() may itself calloc() before there is a real one to call. */
+static char early[4096];
+static size_t early_used;
+static int initializing;
+
+static void init(void)
+{
+	initializing = 1;
+	real_malloc = dlsym(RTLD_NEXT, "malloc");
+	real_calloc = dlsym(RTLD_NEXT, "calloc");
+	real_realloc = dlsym(RTLD_NEXT, "realloc");
+	real_free = dlsym(RTLD_NEXT, "free");
+	real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+	initializing = 0;
+}
+
+static void *counted(void *p)
+{
+	if (p) {
+		const size_t n = malloc_usable_size(p);
+		unsigned long long in_use;
+		__atomic_add_fetch(&malloc_count[0], 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&malloc_count[1], n, __ATOMIC_RELAXED);
+		in_use = __atomic_add_fetch(&malloc_count[2], n,
+					    __ATOMIC_RELAXED);
+		if (in_use > malloc_count[3])
+			malloc_count[3] = in_use;
+	}
+	return p;
+}
+
+static void uncounted(void *p)
+{
+	if (p)
+		__atomic_sub_fetch(&malloc_count[2], malloc_usable_size(p),
+				   __ATOMIC_RELAXED);
+}
+
+static int is_early(void *p)
+{
+	return (char *)p >= early && (char *)p < early + sizeof(early);
+}
+
+void *malloc(size_t n)
+{
+	if (!real_malloc)
+		init();
+	return counted(real_malloc(n));
+}
+
+void *calloc(size_t n, size_t size)
+{
+	if (!real_calloc && !initializing)
+		init();
+	if (!real_calloc) {
+		void *p = early + early_used;
+		early_used += (n * size + 15) & ~(size_t)15;
+		if (early_used > sizeof(early))
+			return NULL;
+		return p;
+	}
+	return counted(real_calloc(n, size));
+}
+
+void *realloc(void *p, size_t n)
+{
+	if (!real_realloc)
+		init();
+	if (is_early(p)) {
+		const size_t left = early + sizeof(early) - (char *)p;
+		void *q = malloc(n);
+		if (q)
+			memcpy(q, p, n < left ? n : left);
+		return q;
+	}
+	uncounted(p);
+	return counted(real_realloc(p, n));
+}
+
+void free(void *p)
+{
+	if (is_early(p))
+		return;
+	if (!real_free)
+		init();
+	uncounted(p);
+	real_free(p);
+}
+
+int posix_memalign(void **p, size_t align, size_t n)
+{
+	int ret;
+	if (!real_posix_memalign)
+		init();
+	ret = real_posix_memalign(p, align, n);
+	if (!ret)
+		counted(*p);
+	return ret;
+}
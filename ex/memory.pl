@@ -0,0 +1,114 @@
+#!/usr/bin/env perl
+use strict;
+use warnings;
+
+use B ();
+use DynaLoader ();
+
+use Compress::Snappy qw(compress decompress);
+
+# Memory used by compress() and decompress(), by payload size: how many
+# allocations a call makes and how many bytes they take, the page faults
+# and peak RSS growth of a call, and how much of the returned string's
+# buffer (SvLEN) is used (SvCUR). Payloads are cut from the given files.
+#
+# Allocations are only counted with ex/malloc_count.c preloaded:
+#
+#   cc -O2 -shared -fPIC -o malloc_count.so ex/malloc_count.c -ldl
+#   LD_PRELOAD=./malloc_count.so perl -Mblib ex/memory.pl file ...
+#
+# Peak RSS needs Linux's /proc/self/clear_refs.
+
+@ARGV or die "usage: $0 file ...\n";
+
+my $all = '';
+for my $file (@ARGV) {
+    open my $fh, '<:raw', $file or die "Cannot open $file: $!\n";
+    local $/;
+    $all .= <$fh>;
+}
+length $all or die "No data\n";
+
+my $counts = malloc_count();
+warn "No allocation counts without malloc_count.so preloaded\n"
+    unless $counts;
+
+printf "%-10s %9s %9s %11s %8s %9s %10s %10s %7s\n", '', 'bytes',
+    'allocs', 'KiB alloc', 'faults', 'peak KiB', 'SvCUR', 'SvLEN',
+    'unused';
+for (my $size = 64; $size <= 16 << 20; $size *= 4) {
+    my $in = substr $all x (1 + $size / length $all), 0, $size;
+    my $packed = compress($in);
+    # Enough calls to average over, in reasonable time.
+    my $calls = (64 << 20) / $size;
+    $calls = $calls < 10 ? 10 : $calls > 1000 ? 1000 : int $calls;
+    for my $op ([ compress => sub { compress($in) } ],
+            [ decompress => sub { decompress($packed) } ]) {
+        my ($name, $sub) = @$op;
+        $sub->();
+
+        my @before = allocations();
+        my $faults = minor_faults();
+        $sub->() for 1 .. $calls;
+        $faults = (minor_faults() - $faults) / $calls;
+        my @after = allocations();
+
+        my $rss = reset_peak_rss();
+        my $out = $sub->();
+        my $peak = defined $rss ? peak_rss() - $rss : undef;
+        my $sv = B::svref_2object(\$out);
+
+        printf "%-10s %9d %9s %11s %8.1f %9s %10d %10d %6.1f%%\n", $name,
+            $size,
+            @before ? sprintf('%.1f', ($after[0] - $before[0]) / $calls)
+                : '-',
+            @before ? sprintf('%.1f',
+                ($after[1] - $before[1]) / $calls / 1024) : '-',
+            $faults, defined $peak ? $peak : '-', $sv->CUR, $sv->LEN,
+            100 * ($sv->LEN - $sv->CUR) / $sv->LEN;
+    }
+}
+printf "\nPeak RSS of the process: %s KiB\n", status('VmHWM') // '-';
+
+exit;
+
+
+# The address of malloc_count[], if the library is preloaded.
+sub malloc_count {
+    my ($lib) = grep { /malloc_count/ } split /[: ]/, $ENV{LD_PRELOAD} || '';
+    return unless $lib;
+    my $ref = DynaLoader::dl_load_file($lib, 0) or return;
+    return DynaLoader::dl_find_symbol($ref, 'malloc_count');
+}
+
+# Allocations and bytes allocated so far.
+sub allocations {
+    return unless $counts;
+    return (unpack 'Q4', unpack 'P32', pack 'J', $counts)[ 0, 1 ];
+}
+
+sub minor_faults {
+    open my $fh, '<', '/proc/self/stat' or return 0;
+    my $stat = <$fh>;
+    $stat =~ s/.*\) //;
+    return (split ' ', $stat)[7];
+}
+
+sub status {
+    my ($key) = @_;
+    open my $fh, '<', '/proc/self/status' or return;
+    while (<$fh>) {
+        return $1 if /^$key:\s+(\d+)/;
+    }
+    return;
+}
+
+# Resets VmHWM to the current RSS, and returns that.
+sub reset_peak_rss {
+    open my $fh, '>', '/proc/self/clear_refs' or return;
+    print $fh "5\n";
+    close $fh or return;
+    return status('VmRSS');
+}
+
+sub peak_rss { status('VmHWM') }
@@ -0,0 +1,420 @@
+/*
+Microbenchmarks of the kernels inside the compressor and decompressor, one
+at a time: FindMatchLength, EmitLiteral with and without its fast path,
+EmitCopy, IncrementalCopyFastPath and SAW__AppendFromSelf, in every
+variant the CPU can run.
+
+Built on its own from the sources, from the top of the distribution:
+
+    cc -O2 -DHAVE_BUILTIN_CTZ -DHAVE_BUILTIN_CPU_SUPPORTS \
+        -o microbench ex/microbench.c
+
+and run on sample files:
+
+    ./microbench [-n runs] [-t msecs] file ...
+
+The files are compressed, and the literals and copies that come out are
+replayed against the uncompressed data, so the kernels see the lengths,
+offsets and bytes of real data. The compressor's kernels see matches
+whole, the decompressor's the copies of at most 64 bytes they are split
+into. Reports the best of the runs (10 by default, each at least 50 ms
+long) as nanoseconds per call and MB/s of the bytes the calls cover.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/csnappy_compress.c"
+#include "../src/csnappy_decompress.c"
+#include "../src/csnappy_dispatch.c"
+
+/* A literal, with offset 0, or a copy, at pos in the uncompressed data. */
+struct element {
+	uint32_t pos, offset, len;
+};
+
+struct elements {
+	struct element *e;
+	uint32_t n, max;
+	uint64_t bytes;
+};
+
+static char *data, *out;
+static uint32_t data_len;
+static struct elements literals, matches, copies;
+static volatile uint64_t sink;
+
+static int runs = 10;
+static double min_time = 0.05;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void add(struct elements *l, uint32_t pos, uint32_t offset,
+		uint32_t len)
+{
+	if (l->n == l->max) {
+		l->max = l->max ? 2 * l->max : 1024;
+		l->e = realloc(l->e, l->max * sizeof(*l->e));
+	}
+	l->e[l->n].pos = pos;
+	l->e[l->n].offset = offset;
+	l->e[l->n].len = len;
+	l->n++;
+	l->bytes += len;
+}
+
+/*
+ * Walks the compressed form of data[base..], made by us so known good,
+ * and records its elements. Copies following on from one another at the
+ * same offset are one match as far as the compressor is concerned.
+ */
+static void parse(const char *ip, const char *end, uint32_t pos)
+{
+	struct element *m;
+	uint32_t len, offset;
+
+	while (*ip++ & 0x80)
+		;
+	while (ip < end) {
+		const unsigned char tag = *ip++;
+		switch (tag & 3) {
+		case LITERAL:
+			len = (tag >> 2) + 1;
+			if (len > 60) {
+				const int n = len - 60;
+				len = 1 + (get_unaligned_le32(ip) &
+					   (0xffffffffu >> (32 - 8 * n)));
+				ip += n;
+			}
+			add(&literals, pos, 0, len);
+			ip += len;
+			pos += len;
+			continue;
+		case COPY_1_BYTE_OFFSET:
+			len = 4 + ((tag >> 2) & 7);
+			offset = (tag >> 5) << 8 | (unsigned char)*ip++;
+			break;
+		case COPY_2_BYTE_OFFSET:
+			len = 1 + (tag >> 2);
+			offset = (unsigned char)ip[0] |
+				 (unsigned char)ip[1] << 8;
+			ip += 2;
+			break;
+		default:
+			len = 1 + (tag >> 2);
+			offset = get_unaligned_le32(ip);
+			ip += 4;
+			break;
+		}
+		add(&copies, pos, offset, len);
+		m = matches.n ? &matches.e[matches.n - 1] : NULL;
+		if (m && m->offset == offset && m->pos + m->len == pos) {
+			m->len += len;
+			matches.bytes += len;
+		} else {
+			add(&matches, pos, offset, len);
+		}
+		pos += len;
+	}
+}
+
+/* Where the compressor's block holding pos ends. */
+static const char *block_end(uint32_t pos)
+{
+	const uint32_t end = (pos | (kBlockSize - 1)) + 1;
+	return data + (end < data_len ? end : data_len);
+}
+
+/*
+ * One function per kernel variant, built for its instruction set so that
+ * the kernel inlines into the loop as it does into its real callers.
+ */
+#define FIND_MATCH_LENGTH_BENCH(name, target, fn)			\
+static uint64_t target							\
+name(void)								\
+{									\
+	uint64_t sum = 0;						\
+	uint32_t i;							\
+	for (i = 0; i < matches.n; ++i) {				\
+		const struct element *m = &matches.e[i];		\
+		const char *s2 = data + m->pos + 4;			\
+		sum += fn(s2 - m->offset, s2, block_end(m->pos));	\
+	}								\
+	return sum;							\
+}
+
+#define INCREMENTAL_COPY_BENCH(name, target, fn)			\
+static uint64_t target							\
+name(void)								\
+{									\
+	uint32_t i;							\
+	for (i = 0; i < copies.n; ++i) {				\
+		const struct element *c = &copies.e[i];			\
+		fn(out + c->pos - c->offset, out + c->pos, c->len);	\
+	}								\
+	return out[copies.n ? copies.e[0].pos : 0];			\
+}
+
+#define APPEND_FROM_SELF_BENCH(name, target, fn)			\
+static uint64_t target							\
+name(void)								\
+{									\
+	struct SnappyArrayWriter writer;				\
+	uint64_t errors = 0;						\
+	uint32_t i;							\
+	writer.base = out;						\
+	writer.op_limit = out + data_len;				\
+	for (i = 0; i < copies.n; ++i) {				\
+		writer.op = out + copies.e[i].pos;			\
+		errors += SAW__AppendFromSelf(&writer,			\
+				copies.e[i].offset, copies.e[i].len,	\
+				fn);					\
+	}								\
+	return errors;							\
+}
+
+FIND_MATCH_LENGTH_BENCH(fml_generic, /*NOTHING*/,
+			FindMatchLength_generic)
+#if defined(CSNAPPY_BUILD_SSE2) || defined(CSNAPPY_HAVE_NEON)
+FIND_MATCH_LENGTH_BENCH(fml_sse2, CSNAPPY_TARGET("sse2"),
+			FindMatchLength_sse2)
+#endif
+#if defined(CSNAPPY_BUILD_AVX2)
+FIND_MATCH_LENGTH_BENCH(fml_avx2, CSNAPPY_TARGET("avx2"),
+			FindMatchLength_avx2)
+#endif
+#if defined(CSNAPPY_BUILD_AVX512)
+FIND_MATCH_LENGTH_BENCH(fml_avx512,
+			CSNAPPY_TARGET("avx512bw,avx512vl"),
+			FindMatchLength_avx512)
+#endif
+
+INCREMENTAL_COPY_BENCH(copy_generic, /*NOTHING*/,
+		       IncrementalCopyFastPath_generic)
+APPEND_FROM_SELF_BENCH(append_generic, /*NOTHING*/,
+		       IncrementalCopyFastPath_generic)
+#if defined(CSNAPPY_BUILD_SSSE3) || defined(CSNAPPY_HAVE_NEON)
+INCREMENTAL_COPY_BENCH(copy_shuffle, CSNAPPY_TARGET("ssse3"),
+		       IncrementalCopyFastPath_shuffle)
+APPEND_FROM_SELF_BENCH(append_shuffle, CSNAPPY_TARGET("ssse3"),
+		       IncrementalCopyFastPath_shuffle)
+#endif
+
+static uint64_t emit_literal(int allow_fast_path)
+{
+	char *op = out;
+	uint32_t i;
+	for (i = 0; i < literals.n; ++i)
+		op = EmitLiteral(op, data + literals.e[i].pos,
+				 literals.e[i].len, allow_fast_path);
+	return op - out;
+}
+
+static uint64_t emit_literal_fast(void) { return emit_literal(1); }
+static uint64_t emit_literal_slow(void) { return emit_literal(0); }
+
+static uint64_t emit_copy(void)
+{
+	char *op = out;
+	uint32_t i;
+	for (i = 0; i < matches.n; ++i)
+		op = EmitCopy(op, matches.e[i].offset, matches.e[i].len);
+	return op - out;
+}
+
+struct kernel {
+	const char *name;
+	/* Comma separated CPU features, as csnappy_dispatch.c has them. */
+	const char *features;
+	uint64_t (*run)(void);
+	const struct elements *over;
+};
+
+static const struct kernel kernels[] = {
+	{ "FindMatchLength_generic", "", fml_generic, &matches },
+#if defined(CSNAPPY_BUILD_SSE2) || defined(CSNAPPY_HAVE_NEON)
+	{ "FindMatchLength_sse2", "sse2", fml_sse2, &matches },
+#endif
+#if defined(CSNAPPY_BUILD_AVX2)
+	{ "FindMatchLength_avx2", "avx2", fml_avx2, &matches },
+#endif
+#if defined(CSNAPPY_BUILD_AVX512)
+	{ "FindMatchLength_avx512", "avx512bw,avx512vl", fml_avx512,
+	  &matches },
+#endif
+	{ "EmitLiteral, fast path", "", emit_literal_fast, &literals },
+	{ "EmitLiteral, no fast path", "", emit_literal_slow, &literals },
+	{ "EmitCopy", "", emit_copy, &matches },
+	{ "IncrementalCopyFastPath_generic", "", copy_generic, &copies },
+#if defined(CSNAPPY_BUILD_SSSE3) || defined(CSNAPPY_HAVE_NEON)
+	{ "IncrementalCopyFastPath_shuffle", "ssse3", copy_shuffle, &copies },
+#endif
+	{ "SAW__AppendFromSelf, generic", "", append_generic, &copies },
+#if defined(CSNAPPY_BUILD_SSSE3) || defined(CSNAPPY_HAVE_NEON)
+	{ "SAW__AppendFromSelf, shuffle", "ssse3", append_shuffle, &copies },
+#endif
+};
+
+static int supported(const char *features)
+{
+#if defined(CSNAPPY_DISPATCH_X86)
+	struct csnappy_variant v;
+	memset(&v, 0, sizeof(v));
+	v.features = features;
+	return variant_supported(&v);
+#else
+	/* Only the baseline's kernels are built. */
+	(void)features;
+	return 1;
+#endif
+}
+
+/* Best time of one pass over all the elements. */
+static double measure(const struct kernel *k)
+{
+	double t, best = 1e30;
+	long reps = 1, i;
+	int r;
+
+	sink += k->run();
+	t = now();
+	while ((t = now() - t) < min_time / 4) {
+		reps *= 2;
+		t = now();
+		for (i = 0; i < reps; i++)
+			sink += k->run();
+	}
+	reps = reps * (min_time / t) + 1;
+	for (r = 0; r < runs; r++) {
+		t = now();
+		for (i = 0; i < reps; i++)
+			sink += k->run();
+		t = (now() - t) / reps;
+		if (t < best)
+			best = t;
+	}
+	return best;
+}
+
+static int by_len(const void *a, const void *b)
+{
+	const struct element *x = a, *y = b;
+	return (x->len > y->len) - (x->len < y->len);
+}
+
+static int by_offset(const void *a, const void *b)
+{
+	const struct element *x = a, *y = b;
+	return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+static void distribution(const char *what, const struct elements *l,
+			 int (*order)(const void *, const void *))
+{
+	static const int pct[] = { 10, 50, 90, 99 };
+	struct element *sorted;
+	unsigned i;
+
+	if (!l->n)
+		return;
+	sorted = malloc(l->n * sizeof(*sorted));
+	memcpy(sorted, l->e, l->n * sizeof(*sorted));
+	qsort(sorted, l->n, sizeof(*sorted), order);
+	printf("%-16s %9u", what, l->n);
+	for (i = 0; i < sizeof(pct) / sizeof(pct[0]); ++i) {
+		const struct element *e = &sorted[(uint64_t)l->n * pct[i] / 100];
+		printf(" %7u", order == by_len ? e->len : e->offset);
+	}
+	printf("\n");
+	free(sorted);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: microbench [-n runs] [-t msecs] file ...\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	char *comp, *wmem;
+	uint32_t comp_len;
+	unsigned i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:t:")) != -1) {
+		switch (opt) {
+		case 'n': runs = atoi(optarg); break;
+		case 't': min_time = atof(optarg) / 1000; break;
+		default: usage();
+		}
+	}
+	if (optind == argc || runs < 1)
+		usage();
+
+	/* All the files end to end, each compressed on its own. */
+	wmem = malloc(CSNAPPY_WORKMEM_BYTES);
+	for (; optind < argc; ++optind) {
+		FILE *fp = fopen(argv[optind], "rb");
+		long len;
+		if (!fp) {
+			perror(argv[optind]);
+			return 1;
+		}
+		fseek(fp, 0, SEEK_END);
+		len = ftell(fp);
+		rewind(fp);
+		if (len <= 0 || data_len + (uint64_t)len > 0x40000000) {
+			fclose(fp);
+			continue;
+		}
+		data = realloc(data, data_len + len);
+		if (fread(data + data_len, 1, len, fp) != (size_t)len) {
+			perror(argv[optind]);
+			return 1;
+		}
+		fclose(fp);
+		comp = malloc(csnappy_max_compressed_length(len));
+		csnappy_compress(data + data_len, len, comp, &comp_len, wmem,
+				 CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO);
+		parse(comp, comp + comp_len, data_len);
+		free(comp);
+		data_len += len;
+	}
+	free(wmem);
+	if (!data_len) {
+		fprintf(stderr, "microbench: no data\n");
+		return 1;
+	}
+	/* Room for the fast paths' overruns, see kMaxIncrementCopyOverflow. */
+	out = malloc(csnappy_max_compressed_length(data_len) + 64);
+	memcpy(out, data, data_len);
+
+	printf("%-16s %9s %7s %7s %7s %7s\n", "", "count", "p10", "p50",
+	       "p90", "p99");
+	distribution("literal length", &literals, by_len);
+	distribution("match length", &matches, by_len);
+	distribution("match offset", &matches, by_offset);
+	distribution("copy length", &copies, by_len);
+	printf("\n%-32s %10s %8s %9s\n", "kernel", "bytes/call", "ns/call",
+	       "MB/s");
+	for (i = 0; i < sizeof(kernels) / sizeof(kernels[0]); ++i) {
+		const struct kernel *k = &kernels[i];
+		double t;
+		if (!supported(k->features) || !k->over->n)
+			continue;
+		t = measure(k);
+		printf("%-32s %10.1f %8.2f %9.1f\n", k->name,
+		       (double)k->over->bytes / k->over->n,
+		       t * 1e9 / k->over->n, k->over->bytes / t / 1e6);
+	}
+	return 0;
+}
@@ -0,0 +1,214 @@
+#!/usr/bin/env perl
+use strict;
+use warnings;
+
+use File::Spec;
+use Getopt::Long qw(GetOptions :config no_ignore_case);
+use JSON::PP ();
+use Time::HiRes qw(clock_gettime CLOCK_MONOTONIC);
+
+use Compress::Snappy qw(compress decompress);
+
+sub now { clock_gettime(CLOCK_MONOTONIC) }
+
+# Performance regression gate. Measures throughput, ratio and latency per
+# corpus file and payload size, through the Perl functions so the XS layer
+# is covered too, and either saves them as a baseline:
+#
+#   perl -Mblib ex/regress.pl --save baseline.json corpus/
+#
+# or compares them against one, exiting with 1 if anything got worse by
+# more than the threshold and by more than the spread between runs:
+#
+#   perl -Mblib ex/regress.pl --baseline baseline.json corpus/
+
+my %opts = (
+    runs      => 7,
+    time      => 0.1,
+    threshold => 5,
+    ratio     => 0.5,
+    sizes     => '64,4096,65536',
+    calls     => 2000,
+);
+GetOptions(\%opts, 'runs|n=i', 'time|t=f', 'threshold=f', 'ratio=f',
+    'sizes=s', 'calls=i', 'save|s=s', 'baseline|b=s',
+) && @ARGV && $opts{runs} >= 2 or die <<USAGE;
+usage: $0 [--save FILE | --baseline FILE] [options] path ...
+
+--runs N         runs of each measurement, for their spread (7)
+--time SECS      minimum length of a throughput run (0.1)
+--sizes LIST     payload sizes to time calls on, cut from each file
+                 (64,4096,65536)
+--calls N        calls timed per latency run (2000)
+--threshold PCT  change in speed or latency taken as a regression (5)
+--ratio PCT      change in compression ratio taken as a regression (0.5)
+USAGE
+
+my @files = map { -d $_ ? corpus($_) : $_ } @ARGV;
+
+# Let the CPU settle at its working clock speed before measuring.
+{
+    my ($t, $data) = (now(), join '', map { chr 97 + $_ % 7 } 1 .. 65536);
+    decompress(compress($data)) while now() - $t < 0.5;
+}
+
+my %current = (
+    env     => environment(),
+    metrics => {},
+);
+my @tasks;
+for my $file (@files) {
+    my $data = do {
+        open my $fh, '<:raw', $file or die "Cannot open $file: $!\n";
+        local $/;
+        <$fh>;
+    };
+    next unless length $data;
+    my $name = (File::Spec->splitpath($file))[2];
+    push @tasks, file_tasks($current{metrics}, $name, $data);
+}
+# Run after run of everything, so that the machine getting slower or
+# faster for a while shows in the spread of every metric.
+for my $run (1 .. $opts{runs}) {
+    for my $task (@tasks) {
+        my %sample = $task->();
+        push @{ $current{metrics}{$_}{samples} }, $sample{$_}
+            for keys %sample;
+    }
+}
+
+if ($opts{save}) {
+    open my $fh, '>', $opts{save} or die "Cannot write $opts{save}: $!\n";
+    print $fh JSON::PP->new->canonical->pretty->encode(\%current);
+    close $fh or die "Cannot write $opts{save}: $!\n";
+    printf "Saved %d metrics to %s\n", scalar keys %{ $current{metrics} },
+        $opts{save};
+}
+exit 0 unless $opts{baseline};
+
+my $baseline = do {
+    open my $fh, '<', $opts{baseline}
+        or die "Cannot open $opts{baseline}: $!\n";
+    local $/;
+    JSON::PP->new->decode(<$fh>);
+};
+for my $key (sort keys %{ $current{env} }) {
+    my ($was, $now) = ($baseline->{env}{$key}, $current{env}{$key});
+    warn "Warning: $key was $was, is now $now\n"
+        if defined $was && $was ne $now;
+}
+exit(compare($baseline->{metrics}, $current{metrics}) ? 1 : 0);
+
+
+sub corpus {
+    my ($dir) = @_;
+    opendir my $dh, $dir or die "Cannot open $dir: $!\n";
+    return grep { -f } map { File::Spec->catfile($dir, $_) }
+        sort grep { !/^\./ } readdir $dh;
+}
+
+sub environment {
+    return {
+        module  => $Compress::Snappy::VERSION,
+        kernels => Compress::Snappy::kernel(),
+        perl    => sprintf('%vd', $^V),
+        os      => $^O,
+    };
+}
+
+# Each metric has the samples of all runs, and whether more is better.
+sub add_metric {
+    my ($metrics, $name, $unit, $higher, @samples) = @_;
+    $metrics->{$name} = {
+        unit    => $unit,
+        higher  => $higher ? JSON::PP::true : JSON::PP::false,
+        samples => \@samples,
+    };
+}
+
+# Subs that each take one sample of some metrics of a file, and return
+# them by name.
+sub file_tasks {
+    my ($metrics, $name, $data) = @_;
+    my $packed = compress($data);
+    die "$name does not round trip\n" unless decompress($packed) eq $data;
+    add_metric($metrics, "$name ratio", '%', 0,
+        100 * length($packed) / length $data);
+
+    my @tasks;
+    for my $op ([ compress => sub { compress($data) } ],
+            [ decompress => sub { decompress($packed) } ]) {
+        my ($what, $sub) = @$op;
+        add_metric($metrics, "$name $what MB/s", 'MB/s', 1);
+        push @tasks, sub {
+            my ($calls, $t) = (0, now());
+            do { $sub->(); $calls++ } while now() - $t < $opts{time};
+            return ("$name $what MB/s",
+                $calls * length($data) / (now() - $t) / 1e6);
+        };
+    }
+
+    for my $size (split /,/, $opts{sizes}) {
+        next if $size > length $data;
+        my @in = map { substr $data, int((length($data) - $size) / 16) * $_,
+            $size } 0 .. 15;
+        my @out = map { compress($_) } @in;
+        for my $op ([ compress => sub { compress($in[ $_[0] % 16 ]) } ],
+                [ decompress => sub { decompress($out[ $_[0] % 16 ]) } ]) {
+            my ($what, $sub) = @$op;
+            my $metric = "$name $size bytes $what";
+            add_metric($metrics, "$metric $_ ns", 'ns', 0) for qw(p50 p99);
+            push @tasks, sub {
+                my @t;
+                for my $i (0 .. $opts{calls} - 1) {
+                    my $t = now();
+                    $sub->($i);
+                    push @t, now() - $t;
+                }
+                @t = sort { $a <=> $b } @t;
+                return ("$metric p50 ns" => 1e9 * $t[ @t / 2 ],
+                    "$metric p99 ns" => 1e9 * $t[ @t * 0.99 ]);
+            };
+        }
+    }
+    return @tasks;
+}
+
+sub median {
+    my @x = sort { $a <=> $b } @_;
+    return @x % 2 ? $x[ @x / 2 ] : ($x[ @x / 2 - 1 ] + $x[ @x / 2 ]) / 2;
+}
+
+# A metric regressed when its median got worse by more than the threshold
+# and even the best of the new runs is worse than the worst of the
+# baseline's: the spread between whole runs of the script is larger than
+# within one, so tests that assume independent samples cry wolf.
+sub compare {
+    my ($base, $cur) = @_;
+    my $regressions = 0;
+    printf "%-44s %12s %12s %8s %7s\n", 'metric', 'baseline', 'current',
+        'change', 'spread';
+    for my $name (sort keys %$cur) {
+        my ($old, $new) = ($base->{$name}, $cur->{$name});
+        next unless $old;
+        my @os = sort { $a <=> $b } @{ $old->{samples} };
+        my @ns = sort { $a <=> $b } @{ $new->{samples} };
+        my ($om, $nm) = (median(@os), median(@ns));
+        my $change = $om ? 100 * ($nm - $om) / $om : 0;
+        my $spread = $nm ? 100 * ($ns[-1] - $ns[0]) / $nm : 0;
+        my ($worse, $apart) = $new->{higher}
+            ? (-$change, $ns[-1] < $os[0]) : ($change, $ns[0] > $os[-1]);
+        my $threshold = $new->{unit} eq '%' ? $opts{ratio}
+            : $opts{threshold};
+        my $regressed = $worse > $threshold && $apart;
+        $regressions++ if $regressed;
+        printf "%-44s %12.2f %12.2f %+7.1f%% %6.1f%%%s\n", $name, $om, $nm,
+            $change, $spread, $regressed ? '  REGRESSION' : '';
+    }
+    for my $name (sort grep { !$cur->{$_} } keys %$base) {
+        print "$name: in the baseline only\n";
+    }
+    printf "%d regression%s beyond %s%%\n", $regressions,
+        $regressions == 1 ? '' : 's', $opts{threshold};
+    return $regressions;
+}
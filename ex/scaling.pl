@@ -0,0 +1,174 @@
+#!/usr/bin/env perl
+use strict;
+use warnings;
+
+use Config;
+use Getopt::Long qw(GetOptions :config no_ignore_case);
+use IO::Handle;
+use Time::HiRes qw(clock_gettime CLOCK_MONOTONIC);
+use if $Config{useithreads}, 'threads';
+use if $Config{useithreads}, 'threads::shared';
+
+# How compress() and decompress() scale across concurrent workers, forked
+# processes or ithreads, working on one copy of the data all share or on
+# a copy each. Reports the aggregate throughput for each number of workers,
+# its efficiency against one worker times as many, and where adding
+# workers stops paying, as when memory bandwidth runs out:
+#
+#   perl -Mblib ex/scaling.pl [options] file ...
+
+my $cpus = cpus();
+my %opts = (
+    workers => join(',', map { 2 ** $_ } 0 .. log(2 * $cpus) / log 2),
+    how     => 'fork,threads',
+    data    => 'shared,private',
+    op      => 'compress,decompress',
+    size    => 65536,
+    time    => 1,
+);
+GetOptions(\%opts, 'workers|w=s', 'how=s', 'data=s', 'op=s', 'size|s=i',
+    'time|t=f',
+) && @ARGV or die <<USAGE;
+usage: $0 [options] file ...
+
+--workers LIST   numbers of workers ($opts{workers})
+--how LIST       fork, threads or both ($opts{how})
+--data LIST      shared: one copy for all, private: a copy each
+                 ($opts{data})
+--op LIST        compress, decompress or both ($opts{op})
+--size BYTES     size of the payload of each call ($opts{size})
+--time SECS      how long the workers run for ($opts{time})
+USAGE
+
+my @how = split /,/, $opts{how};
+if (!$Config{useithreads} && grep { $_ eq 'threads' } @how) {
+    warn "Skipping threads, this perl does not have them\n";
+    @how = grep { $_ ne 'threads' } @how;
+}
+require Compress::Snappy;
+
+my $all = '';
+for my $file (@ARGV) {
+    open my $fh, '<:raw', $file or die "Cannot open $file: $!\n";
+    local $/;
+    $all .= <$fh>;
+}
+length $all or die "No data\n";
+$all = substr $all x (1 + $opts{size} / length $all), 0,
+    $opts{size} * int(length($all) / $opts{size} || 1);
+my @in = unpack "(a$opts{size})*", $all;
+my @packed = map { Compress::Snappy::compress($_) } @in;
+my @shared_in : shared;
+my @shared_packed : shared;
+if (grep { $_ eq 'threads' } @how) {
+    @shared_in = @in;
+    @shared_packed = @packed;
+}
+
+printf "%d CPUs, %d byte payloads, %d of them, %gs runs\n", $cpus,
+    $opts{size}, scalar @in, $opts{time};
+printf "%-8s %-8s %-11s %7s %12s %11s %10s\n", 'how', 'data', 'op',
+    'workers', 'total MB/s', 'per worker', 'efficiency';
+for my $how (@how) {
+    for my $data (split /,/, $opts{data}) {
+        for my $op (split /,/, $opts{op}) {
+            my ($one, $last, $knee);
+            for my $n (split /,/, $opts{workers}) {
+                my $mbps = run($how, $data, $op, $n);
+                $one ||= $mbps / $n;
+                printf "%-8s %-8s %-11s %7d %12.1f %11.1f %9.0f%%\n",
+                    $how, $data, $op, $n, $mbps, $mbps / $n,
+                    100 * $mbps / ($n * $one);
+                # Adding workers no longer adds a tenth more throughput.
+                $knee //= $last->[0]
+                    if $last && $n > $last->[0] && $mbps < 1.1 * $last->[1];
+                $last = [ $n, $mbps ];
+            }
+            printf "%-8s %-8s %-11s scaling stops at %s workers\n\n",
+                $how, $data, $op, $knee // 'more than ' . $last->[0];
+        }
+    }
+}
+
+exit;
+
+
+sub cpus {
+    if (open my $fh, '<', '/proc/cpuinfo') {
+        my $n = grep { /^processor\s*:/ } <$fh>;
+        return $n if $n;
+    }
+    return 1;
+}
+
+sub now { clock_gettime(CLOCK_MONOTONIC) }
+
+# Work for $opts{time}, once $wait returns; the bytes of input handled.
+sub work {
+    my ($data, $op, $wait, $id) = @_;
+    my ($in, $packed);
+    if ($data eq 'shared') {
+        # Forked workers share the parent's pages until they write to
+        # them; threads copy shared variables out on every read.
+        ($in, $packed) = $Config{useithreads} && threads->tid
+            ? (\@shared_in, \@shared_packed) : (\@in, \@packed);
+    }
+    else {
+        $in = [ map { "$_" } @in ];
+        $packed = [ map { "$_" } @packed ];
+    }
+    my $sub = $op eq 'compress'
+        ? sub { Compress::Snappy::compress($in->[ $_[0] ]) }
+        : sub { Compress::Snappy::decompress($packed->[ $_[0] ]) };
+    my $n = @$in;
+    $wait->();
+    my ($i, $t) = ($id, now());
+    my $calls = 0;
+    while (now() - $t < $opts{time}) {
+        $sub->($i++ % $n) for 1 .. 16;
+        $calls += 16;
+    }
+    return $calls * $opts{size};
+}
+
+# Aggregate MB/s of $n workers.
+sub run {
+    my ($how, $data, $op, $n) = @_;
+    my $bytes = 0;
+    if ($how eq 'fork') {
+        # All start together when the parent closes its end of the pipe.
+        pipe my $start, my $go or die "pipe: $!\n";
+        my @kids;
+        for my $id (1 .. $n) {
+            pipe my $result, my $report or die "pipe: $!\n";
+            my $pid = fork // die "fork: $!\n";
+            if (!$pid) {
+                close $go;
+                close $result;
+                print $report work($data, $op, sub { readline $start }, $id), "\n";
+                close $report;
+                require POSIX;
+                POSIX::_exit(0);
+            }
+            close $report;
+            push @kids, [ $pid, $result ];
+        }
+        close $start;
+        close $go;
+        for (@kids) {
+            my ($pid, $result) = @$_;
+            $bytes += readline($result) || 0;
+            waitpid $pid, 0;
+        }
+    }
+    else {
+        # Threads share the file descriptors, so no EOF there.
+        my $go : shared = 0;
+        my $wait = sub { lock $go; cond_wait($go) until $go };
+        my @threads = map { my $id = $_;
+            threads->create(sub { work($data, $op, $wait, $id) }) } 1 .. $n;
+        { lock $go; $go = 1; cond_broadcast($go) }
+        $bytes += $_->join for @threads;
+    }
+    return $bytes / $opts{time} / 1e6;
+}
@@ -12,6 +12,8 @@ extern "C" {
 
 #define CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO 16
 #define CSNAPPY_WORKMEM_BYTES (1 << CSNAPPY_WORKMEM_BYTES_POWER_OF_TWO)
+/* Working memory is best aligned to this, a cache line. */
+#define CSNAPPY_WORKMEM_ALIGN 64
 
 #ifndef __GNUC__
 #define __attribute__(x) /*NOTHING*/
@@ -65,6 +67,59 @@ csnappy_compress(
 	void *working_memory,
 	const int workmem_bytes_power_of_two);
 
+/*
+ * Compressor modes, trading speed for ratio. All produce ordinary snappy
+ * streams.
+ *
+ * CSNAPPY_MODE_FAST is what csnappy_compress() does.
+ * CSNAPPY_MODE_DUAL_HASH also looks matches up by their first six bytes,
+ * in a second table, where the first has found one, and takes those over
+ * four byte ones: 10-30% slower, better on text and other data with long
+ * repeats.
+ * CSNAPPY_MODE_TAGGED keeps part of the bytes at each position in the
+ * table next to it, to reject most false matches without reading the
+ * input, in half as many entries.
+ * CSNAPPY_MODE_DECODE_FAST passes over matches too short to be worth
+ * decoding as copies, for output that decompresses faster and is a little
+ * larger.
+ */
+#define CSNAPPY_MODE_FAST		0
+#define CSNAPPY_MODE_DUAL_HASH		1
+#define CSNAPPY_MODE_TAGGED		2
+#define CSNAPPY_MODE_DECODE_FAST	3
+
+/*
+ * Working memory the modes need for a given workmem_bytes_power_of_two,
+ * enough for any of them.
+ */
+#define CSNAPPY_MODE_WORKMEM_BYTES(power) \
+	((1 << (power)) + (1 << ((power) - 2)))
+
+/*
+ * Same as csnappy_compress_fragment() and csnappy_compress(), in the given
+ * mode. Unknown modes are taken as CSNAPPY_MODE_FAST.
+ * REQUIRES: working_memory has
+ * CSNAPPY_MODE_WORKMEM_BYTES(workmem_bytes_power_of_two) bytes.
+ */
+char*
+csnappy_compress_fragment_mode(
+	const char *input,
+	const uint32_t input_length,
+	char *output,
+	void *working_memory,
+	const int workmem_bytes_power_of_two,
+	const int mode);
+
+void
+csnappy_compress_mode(
+	const char *input,
+	uint32_t input_length,
+	char *compressed,
+	uint32_t *out_compressed_length,
+	void *working_memory,
+	const int workmem_bytes_power_of_two,
+	const int mode);
+
 /*
  * Reads header of compressed data to get stored length of uncompressed data.
  * REQUIRES: start points to compressed data.
@@ -112,6 +167,190 @@ csnappy_decompress_noheader(
 	char *dst,
 	uint32_t *dst_len);
 
+/*
+ * Decompresses the n streams src[i], src_len[i] bytes long, to dst[i],
+ * which has room for dst_len[i] bytes, several at a time, which is faster
+ * for many short streams than one after another. Sets dst_len[i] and
+ * status[i] as csnappy_decompress_noheader() would for each, and returns
+ * CSNAPPY_E_OK if all of them succeeded, or else the status of the first
+ * that did not.
+ */
+int
+csnappy_decompress_noheader_multi(
+	uint32_t	n,
+	const char * const *src,
+	const uint32_t	*src_len,
+	char * const	*dst,
+	uint32_t	*dst_len,
+	int		*status);
+
+/*
+ * Output buffers passed to csnappy_decompress_noheader_trusted() must have
+ * this many bytes to spare after the uncompressed data.
+ */
+#define CSNAPPY_TRUSTED_SLOP_BYTES 64
+
+/*
+ * Faster csnappy_decompress_noheader() for input known to be valid, such
+ * as output of csnappy_compress() that has not left the process: offsets
+ * and the space left at dst are not checked. *dst_len must be the exact
+ * uncompressed length, as read by csnappy_get_uncompressed_length(), and
+ * dst must have room for CSNAPPY_TRUSTED_SLOP_BYTES more, which may be
+ * overwritten. Corrupt input is undefined behaviour, except in builds with
+ * DEBUG defined, which assert on it.
+ */
+int
+csnappy_decompress_noheader_trusted(
+	const char	*src,
+	uint32_t	src_len,
+	char		*dst,
+	uint32_t	*dst_len);
+
+/*
+ * Working memory for csnappy_decompress_noheader_nt(), the part of the
+ * output that is kept in cache while decoding.
+ */
+#define CSNAPPY_NT_WORKMEM_BYTES (1 << 18)
+/* Output size from which non-temporal stores are used by default. */
+#define CSNAPPY_NT_THRESHOLD_DEFAULT (32 << 20)
+
+/*
+ * Same as csnappy_decompress_noheader(), except that outputs of at least
+ * "threshold" bytes are written with non-temporal stores, so that they do
+ * not push everything else out of the caches; the last 64 KiB, likely to
+ * be read next, are written as usual. A threshold of 0 turns this off, as
+ * do builds without SSE2, leaving just csnappy_decompress_noheader().
+ * working_memory must be CSNAPPY_NT_WORKMEM_BYTES long.
+ */
+int
+csnappy_decompress_noheader_nt(
+	const char	*src,
+	uint32_t	src_len,
+	char		*dst,
+	uint32_t	*dst_len,
+	void		*working_memory,
+	uint32_t	threshold);
+
+/*
+ * Experimental decoder with the same interface and results as
+ * csnappy_decompress_noheader(), which parses a batch of elements before
+ * copying any of them. Not selected by any of the above.
+ */
+int
+csnappy_decompress_noheader_twophase(
+	const char	*src,
+	uint32_t	src_len,
+	char		*dst,
+	uint32_t	*dst_len);
+
+/*
+ * The ways csnappy_decompress_noheader() copies, as csnappy_analyze()
+ * counts them. While at least 64 bytes of input and 74 of output are left,
+ * copies at offsets of 8 or more are done with 16 byte moves, shorter
+ * offsets with IncrementalCopyFastPath, and strings of 64 byte copies at
+ * offset 1 or 2 after the first in a single ExpandRun. After that, copies
+ * go through SAW__AppendFromSelf: its fast path for up to 16 bytes at
+ * offsets of 8 or more, IncrementalCopyFastPath, or, for copies that end
+ * within 10 bytes of the end, IncrementalCopy, which memcpy()s one period
+ * of the pattern, then two, four and so on, writing nothing past the copy.
+ * The BMI2 decoder uses SAW__AppendFromSelf all along.
+ */
+#define CSNAPPY_PATH_BULK		0
+#define CSNAPPY_PATH_BULK_PATTERN	1
+#define CSNAPPY_PATH_RUN		2
+#define CSNAPPY_PATH_FAST		3
+#define CSNAPPY_PATH_INCREMENTAL_FAST	4
+#define CSNAPPY_PATH_INCREMENTAL	5
+#define CSNAPPY_PATHS			6
+
+/* Bucket i of a histogram counts the values from 2^i to 2^(i+1) - 1. */
+#define CSNAPPY_HISTOGRAM_BUCKETS	32
+
+/* Blocks of output that csnappy_analyze() reports the input of. */
+#define CSNAPPY_ANALYZE_BLOCK_SIZE	(1 << 15)
+
+/*
+ * One element of a stream: a literal, whose tag is 0, or a copy, 1 to 3
+ * by the size of its offset; at in_pos in the stream, in_len bytes long,
+ * tag and all, and producing length bytes at out_pos.
+ */
+struct csnappy_element {
+	uint32_t tag;
+	uint32_t in_pos, in_len;
+	uint32_t out_pos, length;
+	uint32_t offset;		/* copies only */
+	uint32_t path;			/* copies only, CSNAPPY_PATH_* */
+};
+
+struct csnappy_stats {
+	uint64_t elements[4];		/* by tag */
+	uint64_t bytes[4];		/* of output, by tag */
+	uint64_t paths[CSNAPPY_PATHS];	/* copies */
+	/*
+	 * Consecutive copies at the same offset are taken as one match,
+	 * as the compressor splits matches into copies of at most 64.
+	 */
+	uint64_t literal_lengths[CSNAPPY_HISTOGRAM_BUCKETS];
+	uint64_t match_lengths[CSNAPPY_HISTOGRAM_BUCKETS];
+	uint64_t offsets[CSNAPPY_HISTOGRAM_BUCKETS];
+	uint64_t matches;
+	uint32_t in_len, out_len;
+	/*
+	 * Bytes of input of the elements starting in each block of
+	 * CSNAPPY_ANALYZE_BLOCK_SIZE bytes of output, for as many blocks as
+	 * there is room for; NULL for none.
+	 */
+	uint32_t *block_in;
+	uint32_t blocks;
+};
+
+typedef void (*csnappy_element_fn)(void *arg,
+				   const struct csnappy_element *element);
+
+/*
+ * Walks a stream as csnappy_decompress_noheader() would decode it into
+ * dst_len bytes, without writing anything, and adds up what it is made of
+ * in *stats, which must be zeroed first except for block_in and blocks.
+ * Calls fn, unless it is NULL, with arg and each element in turn. Returns
+ * what csnappy_decompress_noheader() would; after an error, *stats covers
+ * the elements before it.
+ */
+int
+csnappy_analyze(
+	const char	*src,
+	uint32_t	src_len,
+	uint32_t	dst_len,
+	struct csnappy_stats *stats,
+	csnappy_element_fn fn,
+	void		*arg);
+
+/*
+ * Selects the instruction set specific kernels used by all of the above.
+ * "name" is one of the names listed by csnappy_kernels_available(), or NULL
+ * for the best the CPU supports, which is also what is used if this is
+ * never called. "bmi2" is only ever used when named.
+ *
+ * Returns CSNAPPY_E_OK, or CSNAPPY_E_KERNEL_UNSUPPORTED if the CPU or the
+ * build does not have the named kernels, in which case nothing changes.
+ * Not thread safe: call it before compressing or decompressing anything.
+ */
+int
+csnappy_select_kernels(const char *name);
+
+/*
+ * Returns the name of the kernels in use.
+ */
+const char *
+csnappy_kernels_name(void);
+
+/*
+ * Returns the name of the i-th kernels this build and CPU support, from
+ * the most basic to the best and then "bmi2", or NULL once i is past the
+ * last of them.
+ */
+const char *
+csnappy_kernels_available(int i);
+
 /*
  * Return values (< 0 = Error)
  */
@@ -121,6 +360,7 @@ csnappy_decompress_noheader(
 #define CSNAPPY_E_OUTPUT_OVERRUN	(-3)
 #define CSNAPPY_E_INPUT_NOT_CONSUMED	(-4)
 #define CSNAPPY_E_DATA_MALFORMED	(-5)
+#define CSNAPPY_E_KERNEL_UNSUPPORTED	(-6)
 
 #ifdef __cplusplus
 }
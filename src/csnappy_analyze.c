@@ -0,0 +1,188 @@
+/*
+What compressed streams are made of, element by element, for finding out
+why some data compresses poorly or decodes slowly: see csnappy_analyze().
+
+Tags are parsed and checked as DecompressBulkTag and DecompressTailTags do,
+with the tables and limits of csnappy_decompress.c, which this is included
+after, but nothing is written.
+
+Not for the kernel.
+*/
+
+#include "csnappy_internal.h"
+#include "csnappy.h"
+
+struct analysis {
+	struct csnappy_stats *stats;
+	csnappy_element_fn fn;
+	void *arg;
+	/* The match being added up, if match_length. */
+	uint32_t match_offset, match_length;
+};
+
+static INLINE uint32_t
+histogram_bucket(uint32_t value)
+{
+	uint32_t bucket = 0;
+	while (value >>= 1)
+		++bucket;
+	return bucket;
+}
+
+static void
+end_match(struct analysis *a)
+{
+	if (a->match_length) {
+		a->stats->match_lengths[histogram_bucket(a->match_length)]++;
+		a->stats->matches++;
+		a->match_length = 0;
+	}
+}
+
+static void
+count(struct analysis *a, const struct csnappy_element *e)
+{
+	struct csnappy_stats *s = a->stats;
+	const uint32_t block = e->out_pos / CSNAPPY_ANALYZE_BLOCK_SIZE;
+
+	s->elements[e->tag]++;
+	s->bytes[e->tag] += e->length;
+	if (s->block_in && block < s->blocks)
+		s->block_in[block] += e->in_len;
+	if (e->tag) {
+		s->paths[e->path]++;
+		s->offsets[histogram_bucket(e->offset)]++;
+		if (a->match_length && e->offset == a->match_offset) {
+			a->match_length += e->length;
+		} else {
+			end_match(a);
+			a->match_offset = e->offset;
+			a->match_length = e->length;
+		}
+	} else {
+		end_match(a);
+		s->literal_lengths[histogram_bucket(e->length)]++;
+	}
+	if (a->fn)
+		a->fn(a->arg, e);
+}
+
+static INLINE uint32_t
+read_le(const uint8_t *p, uint32_t n)
+{
+	uint32_t v = 0, i;
+	for (i = 0; i < n; ++i)
+		v |= (uint32_t)p[i] << (8 * i);
+	return v;
+}
+
+int
+csnappy_analyze(
+	const char	*src,
+	uint32_t	src_len,
+	uint32_t	dst_len,
+	struct csnappy_stats *stats,
+	csnappy_element_fn fn,
+	void		*arg)
+{
+	const uint8_t * const start = (const uint8_t *)src;
+	const uint8_t * const end = start + src_len;
+	const uint8_t *ip = start;
+	uint32_t op = 0, opword, extra_bytes, space_left, max, n;
+	struct csnappy_element e;
+	struct analysis a;
+	uint8_t opcode;
+	/* Where DecompressBulkTags hands over to DecompressTailTags. */
+	int bulk = src_len > kSlopBytes &&
+		   dst_len > kSlopBytes + kMaxIncrementCopyOverflow;
+	int ret = CSNAPPY_E_OK;
+
+	a.stats = stats;
+	a.fn = fn;
+	a.arg = arg;
+	a.match_length = 0;
+	while (ip < end) {
+		if (bulk && (ip >= end - kSlopBytes || op >= dst_len -
+			     (kSlopBytes + kMaxIncrementCopyOverflow)))
+			bulk = 0;
+		e.in_pos = ip - start;
+		e.out_pos = op;
+		e.offset = 0;
+		e.path = 0;
+		opcode = *ip++;
+		e.tag = opcode & 0x3;
+		if (e.tag) {
+			opword = char_table[opcode];
+			extra_bytes = opword >> 11;
+			if ((uint32_t)(end - ip) < extra_bytes) {
+				ret = CSNAPPY_E_DATA_MALFORMED;
+				break;
+			}
+			e.offset = read_le(ip, extra_bytes) + (opword & 0x700);
+			e.length = opword & 0xff;
+			ip += extra_bytes;
+			/* -1u catches offset==0 */
+			if (op <= e.offset - 1u) {
+				ret = CSNAPPY_E_DATA_MALFORMED;
+				break;
+			}
+			space_left = dst_len - op;
+			if (bulk)
+				e.path = e.offset >= 8 ? CSNAPPY_PATH_BULK :
+					 CSNAPPY_PATH_BULK_PATTERN;
+			else if (e.length <= 16 && e.offset >= 8 &&
+				 space_left >= 16)
+				e.path = CSNAPPY_PATH_FAST;
+			else if (space_left >=
+				 e.length + kMaxIncrementCopyOverflow)
+				e.path = CSNAPPY_PATH_INCREMENTAL_FAST;
+			else if (space_left >= e.length)
+				e.path = CSNAPPY_PATH_INCREMENTAL;
+			else {
+				ret = CSNAPPY_E_OUTPUT_OVERRUN;
+				break;
+			}
+		} else {
+			e.length = (opcode >> 2) + 1;
+			if (e.length > 60) {
+				extra_bytes = e.length - 60;
+				if ((uint32_t)(end - ip) < extra_bytes) {
+					ret = CSNAPPY_E_DATA_MALFORMED;
+					break;
+				}
+				e.length = read_le(ip, extra_bytes) + 1;
+				ip += extra_bytes;
+			}
+			if ((uint32_t)(end - ip) < e.length) {
+				ret = CSNAPPY_E_DATA_MALFORMED;
+				break;
+			}
+			if (dst_len - op < e.length) {
+				ret = CSNAPPY_E_OUTPUT_OVERRUN;
+				break;
+			}
+			ip += e.length;
+		}
+		e.in_len = ip - start - e.in_pos;
+		op += e.length;
+		count(&a, &e);
+		if (!bulk || opcode != 0xfe || e.offset > 2)
+			continue;
+		/* The copies that follow as ExpandRun would take them. */
+		max = min((uint32_t)(end - ip) / 3, (dst_len - op) / 64);
+		for (n = 0; n < max && ip[0] == 0xfe && ip[1] == e.offset &&
+		     ip[2] == 0; ++n) {
+			e.in_pos = ip - start;
+			e.in_len = 3;
+			e.out_pos = op;
+			e.path = CSNAPPY_PATH_RUN;
+			ip += 3;
+			op += 64;
+			count(&a, &e);
+		}
+	}
+	end_match(&a);
+	stats->in_len = ip - start;
+	stats->out_len = op;
+	return ret;
+}
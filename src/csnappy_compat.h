@@ -13,4 +13,15 @@
 #   endif
 #endif
 
+/* For bodies that are stamped out once per instruction set. */
+#ifndef ALWAYS_INLINE
+#   if defined(_MSC_VER)
+#     define ALWAYS_INLINE __forceinline
+#   elif defined(__GNUC__)
+#     define ALWAYS_INLINE inline __attribute__((always_inline))
+#   else
+#     define ALWAYS_INLINE INLINE
+#   endif
+#endif
+
 #endif
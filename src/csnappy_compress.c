@@ -216,6 +216,20 @@ the_end:
 	return (char *)op;
 }
 
+/* There is only the one mode here. */
+char*
+csnappy_compress_fragment_mode(
+	const char *input,
+	const uint32_t input_size,
+	char *dst,
+	void *working_memory,
+	const int workmem_bytes_power_of_two,
+	const int mode)
+{
+	return csnappy_compress_fragment(input, input_size, dst,
+			working_memory, workmem_bytes_power_of_two);
+}
+
 #else /* !simple */
 
 /*
@@ -235,6 +249,21 @@ static INLINE uint32_t Hash(const char *p, int shift)
 	return HashBytes(UNALIGNED_LOAD32(p), shift);
 }
 
+/*
+ * Hash of the six bytes at the start of "bytes", in memory order, for the
+ * long key table of CSNAPPY_MODE_DUAL_HASH. The top two bytes are shifted
+ * out before multiplying, so that they do not matter.
+ */
+static INLINE uint32_t HashLongBytes(uint64_t bytes, int shift)
+{
+	const uint64_t kMul = 0x1e35a7bd1e35a7bdULL;
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	return ((bytes << 16) * kMul) >> shift;
+#else
+	return ((bytes >> 16) * kMul) >> shift;
+#endif
+}
+
 
 /*
  * Return the largest n such that
@@ -246,12 +275,15 @@ static INLINE uint32_t Hash(const char *p, int shift)
  * Does not read *(s1 + (s2_limit - s2)) or beyond.
  * Requires that s2_limit >= s2.
  *
+ * There is one version per instruction set; FindMatchLength_best is the
+ * one the build's baseline allows, used unless dispatching at run time.
+ *
  * Separate implementation for x86_64, for speed.  Uses the fact that
  * x86_64 is little endian.
  */
 #if defined(__x86_64__)
 static INLINE int
-FindMatchLength(const char *s1, const char *s2, const char *s2_limit)
+FindMatchLength_generic(const char *s1, const char *s2, const char *s2_limit)
 {
 	uint64_t x;
 	int matched, matching_bits;
@@ -295,7 +327,7 @@ FindMatchLength(const char *s1, const char *s2, const char *s2_limit)
 }
 #else /* !defined(__x86_64__) */
 static INLINE int
-FindMatchLength(const char *s1, const char *s2, const char *s2_limit)
+FindMatchLength_generic(const char *s1, const char *s2, const char *s2_limit)
 {
 	/* Implementation based on the x86-64 version, above. */
 	int matched = 0;
@@ -328,6 +360,165 @@ FindMatchLength(const char *s1, const char *s2, const char *s2_limit)
 }
 #endif /* !defined(__x86_64__) */
 
+#if defined(CSNAPPY_BUILD_SSE2) || defined(CSNAPPY_HAVE_NEON)
+/*
+ * Vectorised versions. They compare 16, 32 (AVX2) or 64 (AVX-512) bytes
+ * at a time and turn the byte equality vector into a bit mask whose lowest
+ * clear bit is the first mismatch. Most matches end within the first few
+ * bytes, so those are settled with one scalar compare before paying for
+ * the vector setup. All of them are little endian only.
+ *
+ * FindMatchLengthTail finishes the job once fewer bytes are left than
+ * the wider loops handle: 16 at a time, then at most one 8-byte compare,
+ * one 4-byte compare and three single bytes, so no load runs past the
+ * limit.
+ */
+static INLINE int CSNAPPY_TARGET("sse2")
+FindMatchLengthTail(const char *s1, const char *s2, const char *s2_limit,
+		    int matched)
+{
+#if defined(CSNAPPY_BUILD_SSE2)
+	while (likely(s2_limit - s2 >= 16)) {
+		const __m128i a = _mm_loadu_si128(
+					(const __m128i *)(s1 + matched));
+		const __m128i b = _mm_loadu_si128((const __m128i *)s2);
+		const uint32_t mask = 0xffff ^ (uint32_t)_mm_movemask_epi8(
+					_mm_cmpeq_epi8(a, b));
+		if (likely(mask))
+			return matched + FindLSBSetNonZero(mask);
+		s2 += 16;
+		matched += 16;
+	}
+#else /* CSNAPPY_HAVE_NEON */
+	while (likely(s2_limit - s2 >= 16)) {
+		const uint8x16_t eq = vceqq_u8(
+				vld1q_u8((const uint8_t *)s1 + matched),
+				vld1q_u8((const uint8_t *)s2));
+		/* Narrow to four mask bits per byte, there is no movemask. */
+		const uint64_t mask = ~vget_lane_u64(vreinterpret_u64_u8(
+				vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+		if (likely(mask))
+			return matched + (FindLSBSetNonZero64(mask) >> 2);
+		s2 += 16;
+		matched += 16;
+	}
+#endif
+	if (s2_limit - s2 >= 8) {
+		const uint64_t x = UNALIGNED_LOAD64(s1 + matched) ^
+				UNALIGNED_LOAD64(s2);
+		if (x)
+			return matched + (FindLSBSetNonZero64(x) >> 3);
+		s2 += 8;
+		matched += 8;
+	}
+	if (s2_limit - s2 >= 4) {
+		const uint32_t x = UNALIGNED_LOAD32(s1 + matched) ^
+				UNALIGNED_LOAD32(s2);
+		if (x)
+			return matched + (FindLSBSetNonZero(x) >> 3);
+		s2 += 4;
+		matched += 4;
+	}
+	while (s2 < s2_limit && s1[matched] == *s2) {
+		++s2;
+		++matched;
+	}
+	return matched;
+}
+
+#define FIND_MATCH_LENGTH_FIRST_EIGHT()					\
+	DCHECK_GE(s2_limit, s2);					\
+	if (likely(s2_limit - s2 >= 8)) {				\
+		const uint64_t x = UNALIGNED_LOAD64(s1) ^		\
+				UNALIGNED_LOAD64(s2);			\
+		if (likely(x))						\
+			return FindLSBSetNonZero64(x) >> 3;		\
+		s2 += 8;						\
+		matched = 8;						\
+	}
+
+static INLINE int CSNAPPY_TARGET("sse2")
+FindMatchLength_sse2(const char *s1, const char *s2, const char *s2_limit)
+{
+	int matched = 0;
+	FIND_MATCH_LENGTH_FIRST_EIGHT();
+	return FindMatchLengthTail(s1, s2, s2_limit, matched);
+}
+#endif /* CSNAPPY_BUILD_SSE2 || CSNAPPY_HAVE_NEON */
+
+#if defined(CSNAPPY_BUILD_AVX2)
+static INLINE int CSNAPPY_TARGET("avx2")
+FindMatchLength_avx2(const char *s1, const char *s2, const char *s2_limit)
+{
+	int matched = 0;
+	FIND_MATCH_LENGTH_FIRST_EIGHT();
+	while (likely(s2_limit - s2 >= 32)) {
+		const __m256i a = _mm256_loadu_si256(
+					(const __m256i *)(s1 + matched));
+		const __m256i b = _mm256_loadu_si256((const __m256i *)s2);
+		const uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(
+					_mm256_cmpeq_epi8(a, b));
+		if (likely(mask))
+			return matched + FindLSBSetNonZero(mask);
+		s2 += 32;
+		matched += 32;
+	}
+	return FindMatchLengthTail(s1, s2, s2_limit, matched);
+}
+#endif /* CSNAPPY_BUILD_AVX2 */
+
+#if defined(CSNAPPY_BUILD_AVX512)
+static INLINE int CSNAPPY_TARGET("avx512bw,avx512vl")
+FindMatchLength_avx512(const char *s1, const char *s2, const char *s2_limit)
+{
+	int matched = 0;
+	FIND_MATCH_LENGTH_FIRST_EIGHT();
+	while (likely(s2_limit - s2 >= 64)) {
+		const __m512i a = _mm512_loadu_si512(s1 + matched);
+		const __m512i b = _mm512_loadu_si512(s2);
+		const uint64_t mask = ~(uint64_t)_mm512_cmpeq_epi8_mask(a, b);
+		if (likely(mask))
+			return matched + FindLSBSetNonZero64(mask);
+		s2 += 64;
+		matched += 64;
+	}
+	if (s2_limit - s2 >= 32) {
+		const __m256i a = _mm256_loadu_si256(
+					(const __m256i *)(s1 + matched));
+		const __m256i b = _mm256_loadu_si256((const __m256i *)s2);
+		const uint32_t mask = ~(uint32_t)_mm256_cmpeq_epi8_mask(a, b);
+		if (likely(mask))
+			return matched + FindLSBSetNonZero(mask);
+		s2 += 32;
+		matched += 32;
+	}
+	return FindMatchLengthTail(s1, s2, s2_limit, matched);
+}
+#endif /* CSNAPPY_BUILD_AVX512 */
+
+#undef FIND_MATCH_LENGTH_FIRST_EIGHT
+
+#if defined(CSNAPPY_HAVE_AVX512)
+#define FindMatchLength_best FindMatchLength_avx512
+#elif defined(CSNAPPY_HAVE_AVX2)
+#define FindMatchLength_best FindMatchLength_avx2
+#elif defined(CSNAPPY_HAVE_SSE2) || defined(CSNAPPY_HAVE_NEON)
+#define FindMatchLength_best FindMatchLength_sse2
+#else
+#define FindMatchLength_best FindMatchLength_generic
+#endif
+
+/*
+ * Prefetching the next table entry, and once skipping the input further
+ * on, is only done when built with -DCSNAPPY_PREFETCH: the table fits in
+ * L2 and the input is read in order, and on the CPUs tried so far,
+ * even with inputs much larger than the last level cache, it made no
+ * difference.
+ */
+#if defined(CSNAPPY_PREFETCH)
+static const int kPrefetchAhead = 512;
+#endif
+
 
 static INLINE char*
 EmitLiteral(char *op, const char *literal, int len, int allow_fast_path)
@@ -397,9 +588,19 @@ EmitCopy(char *op, int offset, int len)
 {
 	/* Emit 64 byte copies but make sure to keep at least four bytes
 	 * reserved */
-	while (len >= 68) {
-		op = EmitCopyLessThan64(op, offset, 64);
-		len -= 64;
+	if (len >= 68) {
+		/*
+		 * Long runs give many of these, all with the same three byte
+		 * tag: store it four bytes at a time, each store's last byte
+		 * being overwritten by the next tag, or the remainder's.
+		 */
+		const uint32_t tag = COPY_2_BYTE_OFFSET + (63 << 2) +
+				     ((uint32_t)offset << 8);
+		do {
+			put_unaligned_le32(tag, op);
+			op += 3;
+			len -= 64;
+		} while (len >= 68);
 	}
 
 	/* Emit an extra 60 byte copy if have too much data to fit in one
@@ -448,6 +649,17 @@ static INLINE uint32_t GetUint32AtOffset(uint64_t v, int offset) {
 #endif
 }
 
+/* The bytes from offset on, in the order HashLongBytes() expects. */
+static INLINE uint64_t GetUint64AtOffset(uint64_t v, int offset) {
+	DCHECK_GE(offset, 0);
+	DCHECK_LE(offset, 2);
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	return v >> (8 * offset);
+#else
+	return v << (8 * offset);
+#endif
+}
+
 #else /* !ARCH_K8 */
 
 typedef const char* EightBytesReference;
@@ -462,30 +674,87 @@ static INLINE uint32_t GetUint32AtOffset(const char* v, int offset) {
 	return UNALIGNED_LOAD32(v + offset);
 }
 
+static INLINE uint64_t GetUint64AtOffset(const char* v, int offset) {
+	DCHECK_GE(offset, 0);
+	DCHECK_LE(offset, 2);
+	return UNALIGNED_LOAD64(v + offset);
+}
+
 #endif /* !ARCH_K8 */
 
 
 #define kInputMarginBytes 15
-char*
-csnappy_compress_fragment(
+typedef int (*find_match_length_fn)(const char *s1, const char *s2,
+				    const char *s2_limit);
+
+/*
+ * Whether CSNAPPY_MODE_DECODE_FAST turns down the four byte match at ip:
+ * unless at least six bytes match, or fifteen for offsets below eight,
+ * which the decoder expands as a pattern, a copy element saves too little
+ * to pay for the time it takes to decode. Reads no further than
+ * kInputMarginBytes past ip.
+ */
+static INLINE int
+SlowToDecode(const char *ip, const char *candidate)
+{
+	if (UNALIGNED_LOAD32(ip + 2) != UNALIGNED_LOAD32(candidate + 2))
+		return 1;
+	return ip - candidate < 8 &&
+	       (UNALIGNED_LOAD64(ip) != UNALIGNED_LOAD64(candidate) ||
+		UNALIGNED_LOAD64(ip + 7) != UNALIGNED_LOAD64(candidate + 7));
+}
+
+/*
+ * The compressor proper. Each instruction set variant below inlines it with
+ * its own FindMatchLength, which the compiler then inlines in turn since
+ * the pointer is a constant, and once per mode, which is constant as well.
+ *
+ * CSNAPPY_MODE_DUAL_HASH keeps a second, smaller table after the first,
+ * hashed on six bytes instead of four. Where a candidate from it matches,
+ * it is taken over the one from the four byte table, as it is much more
+ * likely to lead to a long match. The search still stops on four byte
+ * matches only, which keeps the loop as tight as it was.
+ *
+ * CSNAPPY_MODE_TAGGED makes the table entries 32 bits wide, the position
+ * in the low half and the upper half of the four bytes found there in the
+ * high half, so that most false candidates are rejected without loading
+ * from the input. To stay within the same working memory it has half as
+ * many entries.
+ *
+ * CSNAPPY_MODE_DECODE_FAST passes over short matches, see SlowToDecode(),
+ * for fewer and longer elements.
+ */
+static ALWAYS_INLINE char*
+CompressFragment(
 	const char *input,
 	const uint32_t input_size,
 	char *op,
 	void *working_memory,
-	const int workmem_bytes_power_of_two)
+	const int workmem_bytes_power_of_two,
+	find_match_length_fn FindMatchLength,
+	const int mode)
 {
 	const char *ip, *ip_end, *base_ip, *next_emit, *ip_limit, *next_ip,
 			*candidate, *base;
 	uint16_t *table = (uint16_t *)working_memory;
+	uint16_t *long_table = table + (1 << (workmem_bytes_power_of_two - 1));
+	uint32_t *tagged_table = (uint32_t *)working_memory;
 	EightBytesReference input_bytes;
 	uint32_t hash, next_hash, prev_hash, cur_hash, skip, candidate_bytes;
-	int shift, matched;
+	const char *long_candidate = NULL;
+	uint32_t long_hash, entry, bytes;
+	int shift, long_shift, matched;
+	const int dual = mode == CSNAPPY_MODE_DUAL_HASH;
+	const int tagged = mode == CSNAPPY_MODE_TAGGED;
+	const int decode_fast = mode == CSNAPPY_MODE_DECODE_FAST;
 
 	DCHECK_GE(workmem_bytes_power_of_two, 9);
-	DCHECK_LE(workmem_bytes_power_of_two, 15);
+	DCHECK_LE(workmem_bytes_power_of_two, 16);
 	/* Table of 2^X bytes, need (X-1) bits to address table of uint16_t.
 	 * How many bits of 32bit hash function result are discarded? */
-	shift = 33 - workmem_bytes_power_of_two;
+	shift = 33 - workmem_bytes_power_of_two + tagged;
+	/* And a long key table of 2^(X-2) bytes, addressed by a 64bit hash. */
+	long_shift = 67 - workmem_bytes_power_of_two;
 	/* "ip" is the input pointer, and "op" is the output pointer. */
 	ip = input;
 	DCHECK_LE(input_size, kBlockSize);
@@ -498,7 +767,10 @@ csnappy_compress_fragment(
 	if (unlikely(input_size < kInputMarginBytes))
 		goto emit_remainder;
 
-	memset(working_memory, 0, 1 << workmem_bytes_power_of_two);
+	memset(working_memory, 0, dual ?
+	       (1 << workmem_bytes_power_of_two) +
+	       (1 << (workmem_bytes_power_of_two - 2)) :
+	       1 << workmem_bytes_power_of_two);
 
 	ip_limit = input + input_size - kInputMarginBytes;
 	next_hash = Hash(++ip, shift);
@@ -543,13 +815,44 @@ main_loop:
 		if (unlikely(next_ip > ip_limit))
 			goto emit_remainder;
 		next_hash = Hash(next_ip, shift);
-		candidate = base_ip + table[hash];
+#if defined(CSNAPPY_PREFETCH)
+		if (tagged)
+			prefetch(&tagged_table[next_hash]);
+		else
+			prefetch(&table[next_hash]);
+		if (skip > 64)
+			prefetch(next_ip + kPrefetchAhead);
+#endif
+		if (tagged) {
+			bytes = UNALIGNED_LOAD32(ip);
+			entry = tagged_table[hash];
+			candidate = base_ip + (uint16_t)entry;
+			tagged_table[hash] = (bytes & 0xffff0000) |
+					     (ip - base_ip);
+		} else {
+			candidate = base_ip + table[hash];
+			table[hash] = ip - base_ip;
+		}
 		DCHECK_GE(candidate, base_ip);
 		DCHECK_LT(candidate, ip);
-
-		table[hash] = ip - base_ip;
-	} while (likely(UNALIGNED_LOAD32(ip) !=
-			UNALIGNED_LOAD32(candidate)));
+	} while (likely(tagged ? (entry ^ bytes) >> 16 ||
+				bytes != UNALIGNED_LOAD32(candidate) :
+			UNALIGNED_LOAD32(ip) != UNALIGNED_LOAD32(candidate)) ||
+		 (decode_fast && SlowToDecode(ip, candidate)));
+	/*
+	 * The long key table is probed only where the four byte one found a
+	 * match, so the scan above costs no more than in CSNAPPY_MODE_FAST.
+	 * Prefer the six byte candidate when it is a match at all.
+	 */
+	if (dual) {
+		long_hash = HashLongBytes(GetUint64AtOffset(
+				GetEightBytesAt(ip), 0), long_shift);
+		long_candidate = base_ip + long_table[long_hash];
+		long_table[long_hash] = ip - base_ip;
+		if (candidate != long_candidate &&
+		    UNALIGNED_LOAD32(ip) == UNALIGNED_LOAD32(long_candidate))
+			candidate = long_candidate;
+	}
 
 	/*
 	* Step 2: A 4-byte match has been found. We'll later see if more
@@ -586,12 +889,40 @@ main_loop:
 			goto emit_remainder;
 		input_bytes = GetEightBytesAt(ip - 1);
 		prev_hash = HashBytes(GetUint32AtOffset(input_bytes, 0), shift);
-		table[prev_hash] = ip - base_ip - 1;
 		cur_hash = HashBytes(GetUint32AtOffset(input_bytes, 1), shift);
-		candidate = base_ip + table[cur_hash];
-		candidate_bytes = UNALIGNED_LOAD32(candidate);
-		table[cur_hash] = ip - base_ip;
-	} while (GetUint32AtOffset(input_bytes, 1) == candidate_bytes);
+		if (tagged) {
+			bytes = GetUint32AtOffset(input_bytes, 0);
+			tagged_table[prev_hash] = (bytes & 0xffff0000) |
+						  (ip - base_ip - 1);
+			bytes = GetUint32AtOffset(input_bytes, 1);
+			entry = tagged_table[cur_hash];
+			candidate = base_ip + (uint16_t)entry;
+			candidate_bytes = (entry ^ bytes) >> 16 ?
+				~bytes : UNALIGNED_LOAD32(candidate);
+			tagged_table[cur_hash] = (bytes & 0xffff0000) |
+						 (ip - base_ip);
+		} else {
+			table[prev_hash] = ip - base_ip - 1;
+			candidate = base_ip + table[cur_hash];
+			candidate_bytes = UNALIGNED_LOAD32(candidate);
+			table[cur_hash] = ip - base_ip;
+		}
+		if (dual) {
+			long_hash = HashLongBytes(GetUint64AtOffset(
+					input_bytes, 0), long_shift);
+			long_table[long_hash] = ip - base_ip - 1;
+			long_hash = HashLongBytes(GetUint64AtOffset(
+					input_bytes, 1), long_shift);
+			long_candidate = base_ip + long_table[long_hash];
+			long_table[long_hash] = ip - base_ip;
+			if (GetUint32AtOffset(input_bytes, 1) ==
+			    UNALIGNED_LOAD32(long_candidate)) {
+				candidate = long_candidate;
+				candidate_bytes = UNALIGNED_LOAD32(candidate);
+			}
+		}
+	} while (GetUint32AtOffset(input_bytes, 1) == candidate_bytes &&
+		 !(decode_fast && SlowToDecode(ip, candidate)));
 
 	next_hash = HashBytes(GetUint32AtOffset(input_bytes, 2), shift);
 	++ip;
@@ -604,9 +935,108 @@ emit_remainder:
 
 	return op;
 }
+
+#if defined(CSNAPPY_DISPATCH_X86)
+#define COMPRESS_FRAGMENT_VARIANT(name, target, find_match_length)	\
+char* target								\
+name(									\
+	const char *input,						\
+	const uint32_t input_size,					\
+	char *op,							\
+	void *working_memory,						\
+	const int workmem_bytes_power_of_two,				\
+	const int mode)							\
+{									\
+	if (mode == CSNAPPY_MODE_DUAL_HASH)				\
+		return CompressFragment(input, input_size, op,		\
+				working_memory,				\
+				workmem_bytes_power_of_two,		\
+				find_match_length,			\
+				CSNAPPY_MODE_DUAL_HASH);		\
+	if (mode == CSNAPPY_MODE_TAGGED)				\
+		return CompressFragment(input, input_size, op,		\
+				working_memory,				\
+				workmem_bytes_power_of_two,		\
+				find_match_length,			\
+				CSNAPPY_MODE_TAGGED);			\
+	if (mode == CSNAPPY_MODE_DECODE_FAST)				\
+		return CompressFragment(input, input_size, op,		\
+				working_memory,				\
+				workmem_bytes_power_of_two,		\
+				find_match_length,			\
+				CSNAPPY_MODE_DECODE_FAST);		\
+	return CompressFragment(input, input_size, op, working_memory,	\
+			workmem_bytes_power_of_two, find_match_length,	\
+			CSNAPPY_MODE_FAST);				\
+}
+
+COMPRESS_FRAGMENT_VARIANT(csnappy_compress_fragment_generic,
+			  /*NOTHING*/, FindMatchLength_generic)
+COMPRESS_FRAGMENT_VARIANT(csnappy_compress_fragment_sse2,
+			  CSNAPPY_TARGET("sse2"), FindMatchLength_sse2)
+COMPRESS_FRAGMENT_VARIANT(csnappy_compress_fragment_avx2,
+			  CSNAPPY_TARGET("avx2"), FindMatchLength_avx2)
+COMPRESS_FRAGMENT_VARIANT(csnappy_compress_fragment_avx512,
+			  CSNAPPY_TARGET("avx512bw,avx512vl"),
+			  FindMatchLength_avx512)
+#undef COMPRESS_FRAGMENT_VARIANT
+
+char*
+csnappy_compress_fragment_mode(
+	const char *input,
+	const uint32_t input_size,
+	char *op,
+	void *working_memory,
+	const int workmem_bytes_power_of_two,
+	const int mode)
+{
+	return csnappy_kernels.compress_fragment(input, input_size, op,
+			working_memory, workmem_bytes_power_of_two, mode);
+}
+#else /* !CSNAPPY_DISPATCH_X86 */
+char*
+csnappy_compress_fragment_mode(
+	const char *input,
+	const uint32_t input_size,
+	char *op,
+	void *working_memory,
+	const int workmem_bytes_power_of_two,
+	const int mode)
+{
+	if (mode == CSNAPPY_MODE_DUAL_HASH)
+		return CompressFragment(input, input_size, op, working_memory,
+				workmem_bytes_power_of_two,
+				FindMatchLength_best, CSNAPPY_MODE_DUAL_HASH);
+	if (mode == CSNAPPY_MODE_TAGGED)
+		return CompressFragment(input, input_size, op, working_memory,
+				workmem_bytes_power_of_two,
+				FindMatchLength_best, CSNAPPY_MODE_TAGGED);
+	if (mode == CSNAPPY_MODE_DECODE_FAST)
+		return CompressFragment(input, input_size, op, working_memory,
+				workmem_bytes_power_of_two,
+				FindMatchLength_best, CSNAPPY_MODE_DECODE_FAST);
+	return CompressFragment(input, input_size, op, working_memory,
+			workmem_bytes_power_of_two, FindMatchLength_best,
+			CSNAPPY_MODE_FAST);
+}
+#endif /* !CSNAPPY_DISPATCH_X86 */
+
+char*
+csnappy_compress_fragment(
+	const char *input,
+	const uint32_t input_size,
+	char *op,
+	void *working_memory,
+	const int workmem_bytes_power_of_two)
+{
+	return csnappy_compress_fragment_mode(input, input_size, op,
+			working_memory, workmem_bytes_power_of_two,
+			CSNAPPY_MODE_FAST);
+}
 #endif /* !simple */
 #if defined(__KERNEL__) && !defined(STATIC)
 EXPORT_SYMBOL(csnappy_compress_fragment);
+EXPORT_SYMBOL(csnappy_compress_fragment_mode);
 #endif
 
 uint32_t __attribute__((const))
@@ -619,13 +1049,14 @@ EXPORT_SYMBOL(csnappy_max_compressed_length);
 #endif
 
 void
-csnappy_compress(
+csnappy_compress_mode(
 	const char *input,
 	uint32_t input_length,
 	char *compressed,
 	uint32_t *compressed_length,
 	void *working_memory,
-	const int workmem_bytes_power_of_two)
+	const int workmem_bytes_power_of_two,
+	const int mode)
 {
 	int workmem_size;
 	int num_to_read;
@@ -644,9 +1075,9 @@ csnappy_compress(
 					break;
 			}
 		}
-		p = csnappy_compress_fragment(
+		p = csnappy_compress_fragment_mode(
 				input, num_to_read, compressed,
-				working_memory, workmem_size);
+				working_memory, workmem_size, mode);
 		written += (p - compressed);
 		compressed = p;
 		input_length -= num_to_read;
@@ -655,6 +1086,23 @@ csnappy_compress(
 	*compressed_length = written;
 }
 #if defined(__KERNEL__) && !defined(STATIC)
+EXPORT_SYMBOL(csnappy_compress_mode);
+#endif
+
+void
+csnappy_compress(
+	const char *input,
+	uint32_t input_length,
+	char *compressed,
+	uint32_t *compressed_length,
+	void *working_memory,
+	const int workmem_bytes_power_of_two)
+{
+	csnappy_compress_mode(input, input_length, compressed,
+			compressed_length, working_memory,
+			workmem_bytes_power_of_two, CSNAPPY_MODE_FAST);
+}
+#if defined(__KERNEL__) && !defined(STATIC)
 EXPORT_SYMBOL(csnappy_compress);
 
 MODULE_LICENSE("BSD");
@@ -135,6 +135,58 @@ int csnappy_decompress_noheader(
 	*dst_len = dst - dst_base;
 	return CSNAPPY_E_OK;
 }
+
+/* Nothing to gain from splitting the byte at a time decoder in two. */
+int csnappy_decompress_noheader_twophase(
+	const char	*src,
+	uint32_t	src_remaining,
+	char		*dst,
+	uint32_t	*dst_len)
+{
+	return csnappy_decompress_noheader(src, src_remaining, dst, dst_len);
+}
+
+/* Nor from trusting the input, as nothing is ever written past the end. */
+int csnappy_decompress_noheader_trusted(
+	const char	*src,
+	uint32_t	src_remaining,
+	char		*dst,
+	uint32_t	*dst_len)
+{
+	return csnappy_decompress_noheader(src, src_remaining, dst, dst_len);
+}
+
+/* Nor from streaming, as there is no SSE2 to stream with. */
+int csnappy_decompress_noheader_nt(
+	const char	*src,
+	uint32_t	src_remaining,
+	char		*dst,
+	uint32_t	*dst_len,
+	void		*working_memory,
+	uint32_t	threshold)
+{
+	return csnappy_decompress_noheader(src, src_remaining, dst, dst_len);
+}
+
+/* Nor from interleaving streams, as it is not short of registers. */
+int csnappy_decompress_noheader_multi(
+	uint32_t	n,
+	const char * const *src,
+	const uint32_t	*src_len,
+	char * const	*dst,
+	uint32_t	*dst_len,
+	int		*status)
+{
+	int first_error = CSNAPPY_E_OK;
+	uint32_t i;
+	for (i = 0; i < n; ++i) {
+		status[i] = csnappy_decompress_noheader(src[i], src_len[i],
+							dst[i], &dst_len[i]);
+		if (status[i] < 0 && first_error == CSNAPPY_E_OK)
+			first_error = status[i];
+	}
+	return first_error;
+}
 #else /* !(arm with no unaligned access) */
 /*
  * Data stored per entry in lookup table:
@@ -185,7 +237,7 @@ static const uint16_t char_table[256] = {
 };
 
 /*
- * Copy "len" bytes from "src" to "op", one byte at a time.  Used for
+ * Copy "len" bytes from "src" to "op" without writing past op + len. Used for
  * handling COPY operations where the input and output regions may
  * overlap.  For example, suppose:
  *    src    == "ab"
@@ -196,15 +248,95 @@ static const uint16_t char_table[256] = {
  *    ababababababababababab
  * Note that this does not match the semantics of either memcpy()
  * or memmove().
+ *
+ * Everything in [src, op) is already a whole number of repetitions of the
+ * pattern, so it can be appended with one non-overlapping memcpy, which
+ * doubles the length the next memcpy may take. Only used close to the end
+ * of the output buffer, so it is kept out of line.
  */
-static INLINE void IncrementalCopy(const char *src, char *op, int len)
+static void __attribute__((noinline))
+IncrementalCopy(const char *src, char *op, int len)
 {
 	DCHECK_GT(len, 0);
 	do {
-		*op++ = *src++;
-	} while (--len > 0);
+		const int chunk = min((int)(op - src), len);
+		memcpy(op, src, chunk);
+		op += chunk;
+		len -= chunk;
+	} while (len > 0);
 }
 
+#if defined(CSNAPPY_BUILD_SSSE3) || defined(CSNAPPY_HAVE_NEON)
+/*
+ * pattern_shuffle[offset - 1] repeats the first "offset" bytes of a vector
+ * across all 16 lanes, for offsets 1..15. pattern_step[offset - 1] is the
+ * largest multiple of offset that is at most 16: storing the same vector
+ * again that many bytes further on continues the pattern seamlessly.
+ */
+static const uint8_t pattern_shuffle[15][16] = {
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 },
+	{ 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1 },
+	{ 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0 },
+	{ 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3, 0, 1, 2, 3 },
+	{ 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0 },
+	{ 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3 },
+	{ 0, 1, 2, 3, 4, 5, 6, 0, 1, 2, 3, 4, 5, 6, 0, 1 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 0, 1, 2, 3, 4, 5, 6 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0, 1, 2, 3, 4, 5 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 0, 1, 2, 3, 4 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 0, 1, 2, 3 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 0, 1, 2 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 0, 1 },
+	{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 0 }
+};
+static const uint8_t pattern_step[15] = {
+	16, 16, 15, 16, 15, 12, 14, 16, 9, 10, 11, 12, 13, 14, 15
+};
+
+/*
+ * Expands the "op - src" byte pattern (1..15 bytes) into "len" bytes at
+ * "op" with one byte shuffle, so no store has to wait for an earlier one to
+ * be forwarded to a load, which is what limits the UnalignedCopy64 loop.
+ * Reads at most 7 bytes past "op" and writes at most 7 bytes past
+ * "op + len", which is within kMaxIncrementCopyOverflow.
+ */
+static INLINE void CSNAPPY_TARGET("ssse3")
+PatternCopy(const char *src, char *op, int len)
+{
+	const int offset = op - src;
+	const int step = pattern_step[offset - 1];
+#if defined(CSNAPPY_BUILD_SSSE3)
+	const __m128i mask = _mm_loadu_si128(
+				(const __m128i *)pattern_shuffle[offset - 1]);
+	const __m128i source = offset <= 8 ?
+		_mm_loadl_epi64((const __m128i *)src) :
+		_mm_loadu_si128((const __m128i *)src);
+	const __m128i pattern = _mm_shuffle_epi8(source, mask);
+	while (len > 8) {
+		_mm_storeu_si128((__m128i *)op, pattern);
+		op += step;
+		len -= step;
+	}
+	if (len > 0)
+		_mm_storel_epi64((__m128i *)op, pattern);
+#else /* CSNAPPY_HAVE_NEON */
+	const uint8x16_t mask = vld1q_u8(pattern_shuffle[offset - 1]);
+	const uint8x16_t source = offset <= 8 ?
+		vcombine_u8(vld1_u8((const uint8_t *)src), vdup_n_u8(0)) :
+		vld1q_u8((const uint8_t *)src);
+	const uint8x16_t pattern = vqtbl1q_u8(source, mask);
+	while (len > 8) {
+		vst1q_u8((uint8_t *)op, pattern);
+		op += step;
+		len -= step;
+	}
+	if (len > 0)
+		vst1_u8((uint8_t *)op, vget_low_u8(pattern));
+#endif
+}
+#endif /* CSNAPPY_BUILD_SSSE3 || CSNAPPY_HAVE_NEON */
+
 /*
  * Equivalent to IncrementalCopy except that it can write up to ten extra
  * bytes after the end of the copy, and that it is faster.
@@ -231,6 +363,8 @@ static INLINE void IncrementalCopy(const char *src, char *op, int len)
  *
  * This allows us to do very well in the special case of one single byte
  * repeated many times, without taking a big hit for more general cases.
+ * Where byte shuffles are available, IncrementalCopyFastPath_shuffle
+ * expands patterns shorter than 16 bytes with PatternCopy instead.
  *
  * The worst case of extra writing past the end of the match occurs when
  * op - src == 1 and len == 1; the last copy will read from byte positions
@@ -238,7 +372,10 @@ static INLINE void IncrementalCopy(const char *src, char *op, int len)
  * position 1. Thus, ten excess bytes.
  */
 static const int kMaxIncrementCopyOverflow = 10;
-static INLINE void IncrementalCopyFastPath(const char *src, char *op, int len)
+typedef void (*incremental_copy_fn)(const char *src, char *op, int len);
+
+static INLINE void
+IncrementalCopyFastPath_generic(const char *src, char *op, int len)
 {
 	while (op - src < 8) {
 		UnalignedCopy64(src, op);
@@ -253,6 +390,22 @@ static INLINE void IncrementalCopyFastPath(const char *src, char *op, int len)
 	}
 }
 
+#if defined(CSNAPPY_BUILD_SSSE3) || defined(CSNAPPY_HAVE_NEON)
+static INLINE void CSNAPPY_TARGET("ssse3")
+IncrementalCopyFastPath_shuffle(const char *src, char *op, int len)
+{
+	if (op - src < 16)
+		PatternCopy(src, op, len);
+	else
+		IncrementalCopyFastPath_generic(src, op, len);
+}
+#endif
+
+#if defined(CSNAPPY_HAVE_SSSE3) || defined(CSNAPPY_HAVE_NEON)
+#define IncrementalCopyFastPath_best IncrementalCopyFastPath_shuffle
+#else
+#define IncrementalCopyFastPath_best IncrementalCopyFastPath_generic
+#endif
 
 /* A type that writes to a flat array. */
 struct SnappyArrayWriter {
@@ -271,7 +424,31 @@ SAW__AppendFastPath(struct SnappyArrayWriter *this,
 		UnalignedCopy64(ip, op);
 		UnalignedCopy64(ip + 8, op + 8);
 	} else {
-                if (unlikely(space_left < (int32_t)len))
+		if (unlikely((uint32_t)space_left < len))
+			return CSNAPPY_E_OUTPUT_OVERRUN;
+		memcpy(op, ip, len);
+	}
+	this->op = op + len;
+	return CSNAPPY_E_OK;
+}
+
+/*
+ * Same as SAW__AppendFastPath for literals of up to 64 bytes, for callers
+ * that know 64 bytes can be read at "ip". The two 32 byte moves are single
+ * vector moves in the AVX2 variants, and most literals need just the one.
+ */
+static INLINE int
+SAW__AppendFastPath64(struct SnappyArrayWriter *this,
+		      const char *ip, uint32_t len)
+{
+	char *op = this->op;
+	const int space_left = this->op_limit - op;
+	if (likely(space_left >= 64)) {
+		memcpy(op, ip, 32);
+		if (unlikely(len > 32))
+			memcpy(op + 32, ip + 32, 32);
+	} else {
+		if (unlikely((uint32_t)space_left < len))
 			return CSNAPPY_E_OUTPUT_OVERRUN;
 		memcpy(op, ip, len);
 	}
@@ -285,16 +462,17 @@ SAW__Append(struct SnappyArrayWriter *this,
 {
 	char *op = this->op;
 	const int space_left = this->op_limit - op;
-        if (unlikely(space_left < (int32_t)len))
+	if (unlikely((uint32_t)space_left < len))
 		return CSNAPPY_E_OUTPUT_OVERRUN;
 	memcpy(op, ip, len);
 	this->op = op + len;
 	return CSNAPPY_E_OK;
 }
 
-static INLINE int
+static ALWAYS_INLINE int
 SAW__AppendFromSelf(struct SnappyArrayWriter *this,
-		    uint32_t offset, uint32_t len)
+		    uint32_t offset, uint32_t len,
+		    incremental_copy_fn IncrementalCopyFastPath)
 {
 	char *op = this->op;
 	const int space_left = this->op_limit - op;
@@ -316,21 +494,162 @@ SAW__AppendFromSelf(struct SnappyArrayWriter *this,
 	return CSNAPPY_E_OK;
 }
 
-int
-csnappy_decompress_noheader(
-	const char	*src,
-	uint32_t	src_remaining,
-	char		*dst,
-	uint32_t	*dst_len)
+/*
+ * Runs of a byte, or of a two byte pattern, come out of the compressor as
+ * strings of identical 64 byte copies at offset 1 or 2. Called once the
+ * first of them has been decoded up to op, expands as many of the ones
+ * following at src as are wholly before src_end and fit before out_end, in
+ * one go: with memset for a single byte, with 64 byte stores of the
+ * pattern for two. Returns how many it took.
+ */
+static INLINE uint32_t
+ExpandRun(const char *src, const char *src_end, char *op, const char *out_end,
+	  uint32_t offset)
+{
+	const uint8_t *tag = (const uint8_t *)src;
+	const uint32_t max = min((uint32_t)(src_end - src) / 3,
+				 (uint32_t)(out_end - op) / 64);
+	uint32_t n = 0, i;
+	char pattern[64];
+
+	while (n < max && tag[0] == 0xfe && tag[1] == offset && tag[2] == 0) {
+		tag += 3;
+		++n;
+	}
+	if (offset == 1) {
+		memset(op, op[-1], n * 64);
+	} else {
+		memcpy(pattern, op - 64, 64);
+		for (i = 0; i < n; ++i)
+			memcpy(op + 64 * i, pattern, 64);
+	}
+	return n;
+}
+
+/*
+ * Elements are decoded in two phases. DecompressBulkTags runs while at
+ * least kSlopBytes of input and kSlopBytes + kMaxIncrementCopyOverflow of
+ * output remain: no tag, trailer or short literal can then reach the end
+ * of either buffer, so the only checks left per element are the ones on
+ * the data itself. DecompressTailTags takes care of the rest, checking
+ * everything and reading the last few bytes of input through a scratch
+ * buffer.
+ */
+#define kSlopBytes 64
+
+/*
+ * Decodes the element at *src_ptr to *op_ptr, for callers that have made
+ * sure of the above, and advances both. out_end is the real end of the
+ * output, which only long literals are checked against; one that does not
+ * fit is left unread, for DecompressNonTemporal to make room for.
+ */
+static ALWAYS_INLINE int
+DecompressBulkTag(const char **src_ptr, const char *src_end,
+		  char **op_ptr, char *base, char *out_end,
+		  incremental_copy_fn IncrementalCopyFastPath)
+{
+	const char *src = *src_ptr;
+	char *op = *op_ptr;
+	uint32_t length, trailer, opword, extra_bytes, i;
+	const uint8_t opcode = *(const uint8_t *)src++;
+
+	if (opcode & 0x3) {
+		const char *from;
+		opword = char_table[opcode];
+		extra_bytes = opword >> 11;
+		trailer = get_unaligned_le(src, extra_bytes);
+		length = opword & 0xff;
+		src += extra_bytes;
+		trailer += opword & 0x700;
+		/* -1u catches offset==0 */
+		if (unlikely((uint32_t)(op - base) <= trailer - 1u))
+			return CSNAPPY_E_DATA_MALFORMED;
+		from = op - trailer;
+		/*
+		 * Same as the fast path of SAW__AppendFromSelf, which most
+		 * copies take, continued for up to 64 bytes.
+		 */
+		if (likely(trailer >= 8)) {
+			UnalignedCopy64(from, op);
+			UnalignedCopy64(from + 8, op + 8);
+			for (i = 16; unlikely(i < length); i += 8)
+				UnalignedCopy64(from + i, op + i);
+		} else {
+			IncrementalCopyFastPath(from, op, length);
+			if (unlikely(opcode == 0xfe) && trailer <= 2) {
+				i = ExpandRun(src, src_end, op + 64, out_end,
+					      trailer);
+				src += 3 * i;
+				length += 64 * i;
+			}
+		}
+	} else if (likely(opcode < (60 << 2))) {
+		/*
+		 * At most 60 bytes, all of them within the slop, so the same
+		 * two 32 byte moves as SAW__AppendFastPath64 are always safe.
+		 */
+		length = (opcode >> 2) + 1;
+		memcpy(op, src, 32);
+		if (unlikely(length > 32))
+			memcpy(op + 32, src + 32, 32);
+		src += length;
+	} else {
+		extra_bytes = (opcode >> 2) - 59;
+		length = get_unaligned_le(src, extra_bytes) + 1;
+		src += extra_bytes;
+		if (unlikely((uint32_t)(src_end - src) < length))
+			return CSNAPPY_E_DATA_MALFORMED;
+		if (unlikely((uint32_t)(out_end - op) < length))
+			return CSNAPPY_E_OUTPUT_OVERRUN;
+		memcpy(op, src, length);
+		src += length;
+	}
+	*src_ptr = src;
+	*op_ptr = op + length;
+	return CSNAPPY_E_OK;
+}
+
+static ALWAYS_INLINE int
+DecompressBulkTags(struct SnappyArrayWriter *writer,
+		   const char **src_ptr, const char *src_end,
+		   incremental_copy_fn IncrementalCopyFastPath)
+{
+	const char *src = *src_ptr, *src_limit;
+	char *op = writer->op, *op_limit;
+	int ret = CSNAPPY_E_OK;
+
+	if (unlikely(src_end - src <= kSlopBytes ||
+		     writer->op_limit - op <=
+				kSlopBytes + kMaxIncrementCopyOverflow))
+		return CSNAPPY_E_OK;
+	src_limit = src_end - kSlopBytes;
+	op_limit = writer->op_limit - (kSlopBytes + kMaxIncrementCopyOverflow);
+	while (likely(src < src_limit && op < op_limit)) {
+		ret = DecompressBulkTag(&src, src_end, &op, writer->base,
+					writer->op_limit,
+					IncrementalCopyFastPath);
+		if (unlikely(ret < 0))
+			break;
+	}
+	writer->op = op;
+	*src_ptr = src;
+	return ret;
+}
+
+/*
+ * Decodes every element of "src" into "writer", checking every read and
+ * write against the end of its buffer.
+ */
+static ALWAYS_INLINE int
+DecompressTailTags(struct SnappyArrayWriter *writer,
+		   const char *src, uint32_t src_remaining,
+		   incremental_copy_fn IncrementalCopyFastPath)
 {
-	struct SnappyArrayWriter writer;
 	const char *end_minus5 = src + src_remaining - 5;
 	uint32_t length, trailer, opword, extra_bytes;
 	int ret, available;
 	uint8_t opcode;
 	char scratch[5];
-	writer.op = writer.base = dst;
-	writer.op_limit = writer.op + *dst_len;
 	#define LOOP_COND() \
 	if (unlikely(src >= end_minus5)) {		\
 		available = end_minus5 + 5 - src;	\
@@ -347,11 +666,14 @@ csnappy_decompress_noheader(
 		if (opcode & 0x3) {
 			opword = char_table[opcode];
 			extra_bytes = opword >> 11;
+			if (unlikely(end_minus5 + 5 - src < (int)extra_bytes))
+				return CSNAPPY_E_DATA_MALFORMED;
 			trailer = get_unaligned_le(src, extra_bytes);
 			length = opword & 0xff;
 			src += extra_bytes;
 			trailer += opword & 0x700;
-			ret = SAW__AppendFromSelf(&writer, trailer, length);
+			ret = SAW__AppendFromSelf(writer, trailer, length,
+						  IncrementalCopyFastPath);
 			if (ret < 0)
 				return ret;
 			LOOP_COND();
@@ -359,7 +681,7 @@ csnappy_decompress_noheader(
 			length = (opcode >> 2) + 1;
 			available = end_minus5 + 5 - src;
 			if (length <= 16 && available >= 16) {
-				if ((ret = SAW__AppendFastPath(&writer, src, length)) < 0)
+				if ((ret = SAW__AppendFastPath(writer, src, length)) < 0)
 					return ret;
 				src += length;
 				LOOP_COND();
@@ -367,13 +689,16 @@ csnappy_decompress_noheader(
 			}
 			if (unlikely(length > 60)) {
 				extra_bytes = length - 60;
+				if (unlikely(available < (int)extra_bytes))
+					return CSNAPPY_E_DATA_MALFORMED;
 				length = get_unaligned_le(src, extra_bytes) + 1;
 				src += extra_bytes;
-				available = end_minus5 + 5 - src;
+				available -= extra_bytes;
 			}
-                        if (unlikely(available < (int32_t)length))
+			/* length may not fit an int */
+			if (unlikely((uint32_t)available < length))
 				return CSNAPPY_E_DATA_MALFORMED;
-			ret = SAW__Append(&writer, src, length);
+			ret = SAW__Append(writer, src, length);
 			if (ret < 0)
 				return ret;
 			src += length;
@@ -382,6 +707,990 @@ csnappy_decompress_noheader(
 	}
 #undef LOOP_COND
 out:
+	return CSNAPPY_E_OK;
+}
+
+/*
+ * Decodes every element of "src" into "writer". Shared by all decoder
+ * variants, which may hand it the remainder of their input, and inlined
+ * into each of them with the IncrementalCopyFastPath for its instruction
+ * set.
+ */
+static ALWAYS_INLINE int
+DecompressAllTags(struct SnappyArrayWriter *writer,
+		  const char *src, uint32_t src_remaining,
+		  incremental_copy_fn IncrementalCopyFastPath)
+{
+	const char * const src_end = src + src_remaining;
+	int ret = DecompressBulkTags(writer, &src, src_end,
+				     IncrementalCopyFastPath);
+	if (ret < 0)
+		return ret;
+	return DecompressTailTags(writer, src, src_end - src,
+				  IncrementalCopyFastPath);
+}
+
+static ALWAYS_INLINE int
+DecompressNoHeader(
+	const char	*src,
+	uint32_t	src_remaining,
+	char		*dst,
+	uint32_t	*dst_len,
+	incremental_copy_fn IncrementalCopyFastPath)
+{
+	struct SnappyArrayWriter writer;
+	int ret;
+	writer.op = writer.base = dst;
+	writer.op_limit = writer.op + *dst_len;
+	ret = DecompressAllTags(&writer, src, src_remaining,
+				IncrementalCopyFastPath);
+	if (ret < 0)
+		return ret;
+	*dst_len = writer.op - writer.base;
+	return CSNAPPY_E_OK;
+}
+
+#if defined(CSNAPPY_DISPATCH_X86)
+/*
+ * char_table widened for the BMI2 decoder: the low 16 bits are the
+ * char_table entry, bits 16..23 hold the number of trailer bits
+ * (8 * extra bytes), ready to be handed to bzhi, and bit 24 is set for
+ * copies, so the tag byte need not be read again. Literal tags 60..63 have
+ * length 1 in char_table, so for every literal the length is simply the
+ * low byte plus the masked trailer, and no tag needs a branch on its
+ * length class.
+ */
+static const uint32_t wide_char_table[256] = {
+	0x00000001, 0x01080804, 0x01101001, 0x01202001,
+	0x00000002, 0x01080805, 0x01101002, 0x01202002,
+	0x00000003, 0x01080806, 0x01101003, 0x01202003,
+	0x00000004, 0x01080807, 0x01101004, 0x01202004,
+	0x00000005, 0x01080808, 0x01101005, 0x01202005,
+	0x00000006, 0x01080809, 0x01101006, 0x01202006,
+	0x00000007, 0x0108080a, 0x01101007, 0x01202007,
+	0x00000008, 0x0108080b, 0x01101008, 0x01202008,
+	0x00000009, 0x01080904, 0x01101009, 0x01202009,
+	0x0000000a, 0x01080905, 0x0110100a, 0x0120200a,
+	0x0000000b, 0x01080906, 0x0110100b, 0x0120200b,
+	0x0000000c, 0x01080907, 0x0110100c, 0x0120200c,
+	0x0000000d, 0x01080908, 0x0110100d, 0x0120200d,
+	0x0000000e, 0x01080909, 0x0110100e, 0x0120200e,
+	0x0000000f, 0x0108090a, 0x0110100f, 0x0120200f,
+	0x00000010, 0x0108090b, 0x01101010, 0x01202010,
+	0x00000011, 0x01080a04, 0x01101011, 0x01202011,
+	0x00000012, 0x01080a05, 0x01101012, 0x01202012,
+	0x00000013, 0x01080a06, 0x01101013, 0x01202013,
+	0x00000014, 0x01080a07, 0x01101014, 0x01202014,
+	0x00000015, 0x01080a08, 0x01101015, 0x01202015,
+	0x00000016, 0x01080a09, 0x01101016, 0x01202016,
+	0x00000017, 0x01080a0a, 0x01101017, 0x01202017,
+	0x00000018, 0x01080a0b, 0x01101018, 0x01202018,
+	0x00000019, 0x01080b04, 0x01101019, 0x01202019,
+	0x0000001a, 0x01080b05, 0x0110101a, 0x0120201a,
+	0x0000001b, 0x01080b06, 0x0110101b, 0x0120201b,
+	0x0000001c, 0x01080b07, 0x0110101c, 0x0120201c,
+	0x0000001d, 0x01080b08, 0x0110101d, 0x0120201d,
+	0x0000001e, 0x01080b09, 0x0110101e, 0x0120201e,
+	0x0000001f, 0x01080b0a, 0x0110101f, 0x0120201f,
+	0x00000020, 0x01080b0b, 0x01101020, 0x01202020,
+	0x00000021, 0x01080c04, 0x01101021, 0x01202021,
+	0x00000022, 0x01080c05, 0x01101022, 0x01202022,
+	0x00000023, 0x01080c06, 0x01101023, 0x01202023,
+	0x00000024, 0x01080c07, 0x01101024, 0x01202024,
+	0x00000025, 0x01080c08, 0x01101025, 0x01202025,
+	0x00000026, 0x01080c09, 0x01101026, 0x01202026,
+	0x00000027, 0x01080c0a, 0x01101027, 0x01202027,
+	0x00000028, 0x01080c0b, 0x01101028, 0x01202028,
+	0x00000029, 0x01080d04, 0x01101029, 0x01202029,
+	0x0000002a, 0x01080d05, 0x0110102a, 0x0120202a,
+	0x0000002b, 0x01080d06, 0x0110102b, 0x0120202b,
+	0x0000002c, 0x01080d07, 0x0110102c, 0x0120202c,
+	0x0000002d, 0x01080d08, 0x0110102d, 0x0120202d,
+	0x0000002e, 0x01080d09, 0x0110102e, 0x0120202e,
+	0x0000002f, 0x01080d0a, 0x0110102f, 0x0120202f,
+	0x00000030, 0x01080d0b, 0x01101030, 0x01202030,
+	0x00000031, 0x01080e04, 0x01101031, 0x01202031,
+	0x00000032, 0x01080e05, 0x01101032, 0x01202032,
+	0x00000033, 0x01080e06, 0x01101033, 0x01202033,
+	0x00000034, 0x01080e07, 0x01101034, 0x01202034,
+	0x00000035, 0x01080e08, 0x01101035, 0x01202035,
+	0x00000036, 0x01080e09, 0x01101036, 0x01202036,
+	0x00000037, 0x01080e0a, 0x01101037, 0x01202037,
+	0x00000038, 0x01080e0b, 0x01101038, 0x01202038,
+	0x00000039, 0x01080f04, 0x01101039, 0x01202039,
+	0x0000003a, 0x01080f05, 0x0110103a, 0x0120203a,
+	0x0000003b, 0x01080f06, 0x0110103b, 0x0120203b,
+	0x0000003c, 0x01080f07, 0x0110103c, 0x0120203c,
+	0x00080801, 0x01080f08, 0x0110103d, 0x0120203d,
+	0x00101001, 0x01080f09, 0x0110103e, 0x0120203e,
+	0x00181801, 0x01080f0a, 0x0110103f, 0x0120203f,
+	0x00202001, 0x01080f0b, 0x01101040, 0x01202040
+};
+
+/*
+ * Decoder for CPUs with BMI2. Trailers are extracted with a single bzhi
+ * instead of the wordmask lookup, and the table entry for the next tag is
+ * loaded before the current copy is issued, so the next iteration's
+ * lookup does not wait on the copy. Runs while a tag and its four
+ * trailer bytes can be read without checks, and then hands the last
+ * bytes to DecompressTailTags. Slower than the SSSE3 decoder on text and
+ * numbers, for one more dependent load between literals, so never chosen
+ * unless asked for by name.
+ */
+int CSNAPPY_TARGET("bmi2,ssse3")
+csnappy_decompress_noheader_bmi2(
+	const char	*src,
+	uint32_t	src_remaining,
+	char		*dst,
+	uint32_t	*dst_len)
+{
+	struct SnappyArrayWriter writer, tail;
+	const char * const src_end = src + src_remaining;
+	uint32_t entry, trailer, length;
+	int ret;
+	writer.op = writer.base = dst;
+	writer.op_limit = writer.op + *dst_len;
+	if (src_remaining > 5) {
+		const char * const src_limit = src_end - 5;
+		const char *next;
+		entry = wide_char_table[*(const uint8_t *)src];
+		while (src < src_limit) {
+			trailer = _bzhi_u32(get_unaligned_le32(src + 1),
+					    (entry >> 16) & 0xff);
+			src += 1 + ((entry >> 19) & 7);
+			if (entry & (1 << 24)) {
+				/* src is at most src_end - 1 here */
+				const uint32_t offset = trailer +
+							(entry & 0x700);
+				length = entry & 0xff;
+				entry = wide_char_table[*(const uint8_t *)src];
+				ret = SAW__AppendFromSelf(&writer, offset,
+						length,
+						IncrementalCopyFastPath_shuffle);
+				if (unlikely(offset <= 2) && length == 64 &&
+				    likely(ret == CSNAPPY_E_OK)) {
+					/* Leaves a byte for the entry. */
+					const uint32_t n = ExpandRun(src,
+						src_end - 1, writer.op,
+						writer.op_limit, offset);
+					src += 3 * n;
+					writer.op += 64 * n;
+					entry = wide_char_table[
+						*(const uint8_t *)src];
+				}
+			} else {
+				length = (entry & 0xff) + trailer;
+				if (length <= 64 && src_end - src > 64) {
+					next = src + length;
+					entry = wide_char_table[
+						*(const uint8_t *)next];
+					ret = SAW__AppendFastPath64(&writer, src,
+								    length);
+				} else {
+					if (unlikely((uint32_t)(src_end - src) <
+						     length))
+						return CSNAPPY_E_DATA_MALFORMED;
+					next = src + length;
+					if (likely(next < src_limit))
+						entry = wide_char_table[
+							*(const uint8_t *)next];
+					ret = SAW__Append(&writer, src, length);
+				}
+				src = next;
+			}
+			if (unlikely(ret < 0))
+				return ret;
+		}
+	}
+	/*
+	 * Finish on a copy of the writer, so that taking its address for
+	 * the tail loop does not keep the one above in memory.
+	 */
+	tail = writer;
+	ret = DecompressTailTags(&tail, src, src_end - src,
+				 IncrementalCopyFastPath_shuffle);
+	if (ret < 0)
+		return ret;
+	*dst_len = tail.op - tail.base;
+	return CSNAPPY_E_OK;
+}
+
+int
+csnappy_decompress_noheader_generic(
+	const char	*src,
+	uint32_t	src_remaining,
+	char		*dst,
+	uint32_t	*dst_len)
+{
+	return DecompressNoHeader(src, src_remaining, dst, dst_len,
+				  IncrementalCopyFastPath_generic);
+}
+
+int CSNAPPY_TARGET("ssse3")
+csnappy_decompress_noheader_ssse3(
+	const char	*src,
+	uint32_t	src_remaining,
+	char		*dst,
+	uint32_t	*dst_len)
+{
+	return DecompressNoHeader(src, src_remaining, dst, dst_len,
+				  IncrementalCopyFastPath_shuffle);
+}
+#endif /* CSNAPPY_DISPATCH_X86 */
+
+int
+csnappy_decompress_noheader(
+	const char	*src,
+	uint32_t	src_remaining,
+	char		*dst,
+	uint32_t	*dst_len)
+{
+#if defined(CSNAPPY_DISPATCH_X86)
+	return csnappy_kernels.decompress_noheader(src, src_remaining,
+						   dst, dst_len);
+#else
+	return DecompressNoHeader(src, src_remaining, dst, dst_len,
+				  IncrementalCopyFastPath_best);
+#endif
+}
+
+/*
+ * Decoder for input that is known to be valid, into a buffer with
+ * CSNAPPY_TRUSTED_SLOP_BYTES to spare after the uncompressed data. Same as
+ * DecompressBulkTags without the checks on the output: neither the offsets
+ * nor the space left are looked at, and the loop runs until the input gets
+ * within kSlopBytes of its end, which DecompressTailTags decodes as usual.
+ * Debug builds still check both with DCHECK.
+ */
+static ALWAYS_INLINE int
+DecompressTrustedNoHeader(
+	const char	*src,
+	uint32_t	src_remaining,
+	char		*dst,
+	uint32_t	*dst_len,
+	incremental_copy_fn IncrementalCopyFastPath)
+{
+	struct SnappyArrayWriter writer;
+	const char * const src_end = src + src_remaining;
+	const char *src_limit;
+	char *op = dst;
+	uint32_t length, trailer, opword, extra_bytes, i;
+	uint8_t opcode;
+	int ret;
+
+	src_limit = src_remaining > kSlopBytes ? src_end - kSlopBytes : src;
+	while (src < src_limit) {
+		opcode = *(const uint8_t *)src++;
+		if (opcode & 0x3) {
+			const char *from;
+			opword = char_table[opcode];
+			extra_bytes = opword >> 11;
+			trailer = get_unaligned_le(src, extra_bytes);
+			length = opword & 0xff;
+			src += extra_bytes;
+			trailer += opword & 0x700;
+			DCHECK_GT(trailer, 0);
+			DCHECK_LE(trailer, (uint32_t)(op - dst));
+			DCHECK_LE(op + length, dst + *dst_len);
+			from = op - trailer;
+			if (likely(trailer >= 8)) {
+				UnalignedCopy64(from, op);
+				UnalignedCopy64(from + 8, op + 8);
+				for (i = 16; unlikely(i < length); i += 8)
+					UnalignedCopy64(from + i, op + i);
+			} else {
+				IncrementalCopyFastPath(from, op, length);
+				if (unlikely(opcode == 0xfe) && trailer <= 2) {
+					i = ExpandRun(src, src_end, op + 64,
+						      dst + *dst_len, trailer);
+					src += 3 * i;
+					length += 64 * i;
+				}
+			}
+		} else if (likely(opcode < (60 << 2))) {
+			length = (opcode >> 2) + 1;
+			DCHECK_LE(op + length, dst + *dst_len);
+			memcpy(op, src, 32);
+			if (unlikely(length > 32))
+				memcpy(op + 32, src + 32, 32);
+			src += length;
+		} else {
+			extra_bytes = (opcode >> 2) - 59;
+			length = get_unaligned_le(src, extra_bytes) + 1;
+			src += extra_bytes;
+			DCHECK_LE(length, (uint32_t)(src_end - src));
+			DCHECK_LE(op + length, dst + *dst_len);
+			memcpy(op, src, length);
+			src += length;
+		}
+		op += length;
+	}
+	writer.base = dst;
+	writer.op = op;
+	writer.op_limit = dst + *dst_len;
+	ret = DecompressTailTags(&writer, src, src_end - src,
+				 IncrementalCopyFastPath);
+	if (ret < 0)
+		return ret;
+	*dst_len = writer.op - writer.base;
+	return CSNAPPY_E_OK;
+}
+
+#if defined(CSNAPPY_DISPATCH_X86)
+int
+csnappy_decompress_noheader_trusted_generic(
+	const char	*src,
+	uint32_t	src_remaining,
+	char		*dst,
+	uint32_t	*dst_len)
+{
+	return DecompressTrustedNoHeader(src, src_remaining, dst, dst_len,
+					 IncrementalCopyFastPath_generic);
+}
+
+int CSNAPPY_TARGET("ssse3")
+csnappy_decompress_noheader_trusted_ssse3(
+	const char	*src,
+	uint32_t	src_remaining,
+	char		*dst,
+	uint32_t	*dst_len)
+{
+	return DecompressTrustedNoHeader(src, src_remaining, dst, dst_len,
+					 IncrementalCopyFastPath_shuffle);
+}
+#endif /* CSNAPPY_DISPATCH_X86 */
+
+int
+csnappy_decompress_noheader_trusted(
+	const char	*src,
+	uint32_t	src_remaining,
+	char		*dst,
+	uint32_t	*dst_len)
+{
+#if defined(CSNAPPY_DISPATCH_X86)
+	return csnappy_kernels.decompress_noheader_trusted(src, src_remaining,
+							   dst, dst_len);
+#else
+	return DecompressTrustedNoHeader(src, src_remaining, dst, dst_len,
+					 IncrementalCopyFastPath_best);
+#endif
+}
+
+/*
+ * Decoding of several streams at once.
+ *
+ * Each element depends on the one before it through the tag byte, so a
+ * single stream of short elements leaves the CPU waiting on loads. Up to
+ * kLanes streams are decoded in turns of one element each instead, so
+ * that the out-of-order core can overlap them. A lane that runs out of
+ * bulk room is finished by DecompressTailTags and takes the next stream.
+ * Streams too short for the bulk loop never take a lane, and batches of
+ * fewer than kLanes are decoded one by one, which costs no more than a
+ * plain loop.
+ */
+#define kLanes 4
+
+struct SnappyLane {
+	const char *src;
+	const char *src_end;
+	const char *src_limit;
+	char *op;
+	char *op_limit;
+	char *base;
+	char *out_end;
+	uint32_t index;
+	int ret;
+};
+
+static INLINE void
+LaneStart(struct SnappyLane *lane, uint32_t index, const char * const *src,
+	  const uint32_t *src_len, char * const *dst, const uint32_t *dst_len)
+{
+	const uint32_t slop = kSlopBytes + kMaxIncrementCopyOverflow;
+	lane->index = index;
+	lane->src = src[index];
+	lane->src_end = src[index] + src_len[index];
+	lane->src_limit = src_len[index] > kSlopBytes ?
+			lane->src_end - kSlopBytes : lane->src;
+	lane->op = lane->base = dst[index];
+	lane->out_end = dst[index] + dst_len[index];
+	lane->op_limit = dst_len[index] > slop ?
+			lane->out_end - slop : lane->op;
+	lane->ret = CSNAPPY_E_OK;
+}
+
+#define LANE_READY(l) ((l).src < (l).src_limit && (l).op < (l).op_limit)
+
+/*
+ * Runs all kLanes lanes in turns while every one of them has bulk room.
+ * The positions are kept in locals, which the stores to the output cannot
+ * alias, so that they can stay in registers.
+ */
+#define LANE_STEP(k)							\
+	do {								\
+		ret = DecompressBulkTag(&src##k, lanes[k].src_end,	\
+				&op##k, lanes[k].base, lanes[k].out_end, \
+				IncrementalCopyFastPath);		\
+		if (unlikely(ret < 0)) {				\
+			/* Makes the lane leave, with its error. */	\
+			lanes[k].ret = ret;				\
+			lanes[k].src_limit = src##k;			\
+		}							\
+	} while (0)
+#define LANE_ROOM(k) \
+	(src##k < lanes[k].src_limit && op##k < lanes[k].op_limit)
+
+static ALWAYS_INLINE void
+DecompressLanes(struct SnappyLane *lanes,
+		incremental_copy_fn IncrementalCopyFastPath)
+{
+	const char *src0 = lanes[0].src, *src1 = lanes[1].src;
+	const char *src2 = lanes[2].src, *src3 = lanes[3].src;
+	char *op0 = lanes[0].op, *op1 = lanes[1].op;
+	char *op2 = lanes[2].op, *op3 = lanes[3].op;
+	int ret;
+
+	while (likely(LANE_ROOM(0) && LANE_ROOM(1) &&
+		      LANE_ROOM(2) && LANE_ROOM(3))) {
+		LANE_STEP(0);
+		LANE_STEP(1);
+		LANE_STEP(2);
+		LANE_STEP(3);
+	}
+	lanes[0].src = src0;
+	lanes[1].src = src1;
+	lanes[2].src = src2;
+	lanes[3].src = src3;
+	lanes[0].op = op0;
+	lanes[1].op = op1;
+	lanes[2].op = op2;
+	lanes[3].op = op3;
+}
+#undef LANE_ROOM
+#undef LANE_STEP
+
+/*
+ * Decodes the streams from "next" on that are too short for the bulk loop
+ * as a single stream, without setting up a lane for them, up to the first
+ * that is not. Returns its index, or n.
+ */
+static ALWAYS_INLINE uint32_t
+DecompressShort(
+	uint32_t	next,
+	uint32_t	n,
+	const char * const *src,
+	const uint32_t	*src_len,
+	char * const	*dst,
+	uint32_t	*dst_len,
+	int		*status,
+	incremental_copy_fn IncrementalCopyFastPath)
+{
+	for (; next < n; ++next) {
+		if (src_len[next] > kSlopBytes && dst_len[next] >
+				kSlopBytes + kMaxIncrementCopyOverflow)
+			break;
+		status[next] = DecompressNoHeader(src[next], src_len[next],
+				dst[next], &dst_len[next],
+				IncrementalCopyFastPath);
+	}
+	return next;
+}
+
+static ALWAYS_INLINE int
+DecompressMulti(
+	uint32_t	n,
+	const char * const *src,
+	const uint32_t	*src_len,
+	char * const	*dst,
+	uint32_t	*dst_len,
+	int		*status,
+	incremental_copy_fn IncrementalCopyFastPath)
+{
+	struct SnappyLane lanes[kLanes];
+	struct SnappyArrayWriter writer;
+	uint32_t next, busy = 0, i;
+	int ret;
+
+	next = DecompressShort(0, n, src, src_len, dst, dst_len, status,
+			       IncrementalCopyFastPath);
+	for (; busy < kLanes && next < n; ++busy) {
+		LaneStart(&lanes[busy], next, src, src_len, dst, dst_len);
+		next = DecompressShort(next + 1, n, src, src_len, dst,
+				       dst_len, status, IncrementalCopyFastPath);
+	}
+	while (busy) {
+		if (busy == kLanes)
+			DecompressLanes(lanes, IncrementalCopyFastPath);
+		for (i = 0; i < busy; ++i) {
+			struct SnappyLane *lane = &lanes[i];
+			/* Waits for the others while there are kLanes. */
+			if (busy == kLanes && LANE_READY(*lane))
+				continue;
+			/*
+			 * The rest of the stream, on its own: the tail, or,
+			 * with fewer than kLanes streams left, all of it, as
+			 * a plain loop would.
+			 */
+			ret = lane->ret;
+			if (ret == CSNAPPY_E_OK) {
+				writer.base = lane->base;
+				writer.op = lane->op;
+				writer.op_limit = lane->out_end;
+				ret = DecompressBulkTags(&writer, &lane->src,
+						lane->src_end,
+						IncrementalCopyFastPath);
+				if (likely(ret == CSNAPPY_E_OK))
+					ret = DecompressTailTags(&writer,
+						lane->src,
+						lane->src_end - lane->src,
+						IncrementalCopyFastPath);
+				lane->op = writer.op;
+			}
+			status[lane->index] = ret;
+			if (ret == CSNAPPY_E_OK)
+				dst_len[lane->index] = lane->op - lane->base;
+			/* Take the next stream, or the last lane's place. */
+			if (next < n) {
+				LaneStart(lane, next, src, src_len, dst,
+					  dst_len);
+				next = DecompressShort(next + 1, n, src,
+						src_len, dst, dst_len, status,
+						IncrementalCopyFastPath);
+			} else {
+				*lane = lanes[--busy];
+			}
+		}
+	}
+	for (i = 0; i < n; ++i) {
+		if (status[i] < 0)
+			return status[i];
+	}
+	return CSNAPPY_E_OK;
+}
+#undef LANE_READY
+
+#if defined(CSNAPPY_DISPATCH_X86)
+int
+csnappy_decompress_noheader_multi_generic(
+	uint32_t	n,
+	const char * const *src,
+	const uint32_t	*src_len,
+	char * const	*dst,
+	uint32_t	*dst_len,
+	int		*status)
+{
+	return DecompressMulti(n, src, src_len, dst, dst_len, status,
+			       IncrementalCopyFastPath_generic);
+}
+
+int CSNAPPY_TARGET("ssse3")
+csnappy_decompress_noheader_multi_ssse3(
+	uint32_t	n,
+	const char * const *src,
+	const uint32_t	*src_len,
+	char * const	*dst,
+	uint32_t	*dst_len,
+	int		*status)
+{
+	return DecompressMulti(n, src, src_len, dst, dst_len, status,
+			       IncrementalCopyFastPath_shuffle);
+}
+#endif /* CSNAPPY_DISPATCH_X86 */
+
+int
+csnappy_decompress_noheader_multi(
+	uint32_t	n,
+	const char * const *src,
+	const uint32_t	*src_len,
+	char * const	*dst,
+	uint32_t	*dst_len,
+	int		*status)
+{
+	int ret = CSNAPPY_E_OK;
+	uint32_t i;
+	/* Too few to interleave: one after the other, as a plain loop. */
+	if (n < kLanes) {
+		for (i = 0; i < n; ++i) {
+			status[i] = csnappy_decompress_noheader(src[i],
+					src_len[i], dst[i], &dst_len[i]);
+			if (status[i] < 0 && ret == CSNAPPY_E_OK)
+				ret = status[i];
+		}
+		return ret;
+	}
+#if defined(CSNAPPY_DISPATCH_X86)
+	return csnappy_kernels.decompress_noheader_multi(n, src, src_len,
+			dst, dst_len, status);
+#else
+	return DecompressMulti(n, src, src_len, dst, dst_len, status,
+			       IncrementalCopyFastPath_best);
+#endif
+}
+
+/*
+ * Decoding with non-temporal stores, for outputs too large to be worth
+ * caching.
+ *
+ * The output is decoded into a stage of CSNAPPY_NT_WORKMEM_BYTES, which
+ * stays in cache. Whenever it fills up, all but the last kNTWindow bytes
+ * are streamed out to dst, and those are moved to the front of the stage,
+ * where copies keep finding them. Streams from the usual compressors, which
+ * never reach back more than 64 KiB, are decoded in one go; anything that
+ * reaches further fails the offset checks against the stage and is decoded
+ * again the ordinary way, as is corrupt input, to tell the two apart.
+ *
+ * The last kNTWindow bytes of the output are written with ordinary stores,
+ * as whoever asked for them is likely to read them next.
+ *
+ * Streaming saves reading every line of dst into the cache before writing
+ * it, which pays for the extra copies through the stage on compressible
+ * data, but not on incompressible data, which is left alone.
+ */
+#define kNTWindow 65536
+
+#if defined(CSNAPPY_HAVE_SSE2)
+/*
+ * Copies n bytes from src to dst, bypassing the cache for every whole
+ * 16 byte block of dst.
+ */
+static void
+StreamCopy(char *dst, const char *src, uint32_t n)
+{
+	while (n && ((uintptr_t)dst & 15)) {
+		*dst++ = *src++;
+		--n;
+	}
+	for (; n >= 64; n -= 64, src += 64, dst += 64) {
+		const __m128i a = _mm_loadu_si128((const __m128i *)src);
+		const __m128i b = _mm_loadu_si128((const __m128i *)src + 1);
+		const __m128i c = _mm_loadu_si128((const __m128i *)src + 2);
+		const __m128i d = _mm_loadu_si128((const __m128i *)src + 3);
+		_mm_stream_si128((__m128i *)dst, a);
+		_mm_stream_si128((__m128i *)dst + 1, b);
+		_mm_stream_si128((__m128i *)dst + 2, c);
+		_mm_stream_si128((__m128i *)dst + 3, d);
+	}
+	for (; n >= 16; n -= 16, src += 16, dst += 16)
+		_mm_stream_si128((__m128i *)dst,
+				 _mm_loadu_si128((const __m128i *)src));
+	memcpy(dst, src, n);
+}
+
+/*
+ * Streams out all of the stage but the last kNTWindow bytes, give or take
+ * a cache line, so that later calls start on one. The stage must hold more
+ * than kNTWindow + 64 bytes.
+ */
+static INLINE void
+NTSlide(struct SnappyArrayWriter *stage, char *dst, uint32_t *flushed)
+{
+	uint32_t n = stage->op - stage->base - kNTWindow;
+	n -= (uintptr_t)(dst + *flushed + n) & 63;
+	StreamCopy(dst + *flushed, stage->base, n);
+	memmove(stage->base, stage->base + n, stage->op - stage->base - n);
+	stage->op -= n;
+	*flushed += n;
+}
+
+/*
+ * Sets the end of the stage, to its size or to the end of the output if
+ * that comes first.
+ */
+static INLINE void
+NTLimit(struct SnappyArrayWriter *stage, uint32_t out_left)
+{
+	stage->op_limit = stage->base + (out_left < CSNAPPY_NT_WORKMEM_BYTES ?
+					 out_left : CSNAPPY_NT_WORKMEM_BYTES);
+}
+
+/*
+ * Appends the literal at *src_ptr, which DecompressBulkTags left unread
+ * for being longer than the room in the stage, sliding as many times as it
+ * takes.
+ */
+static INLINE int
+NTAppendLiteral(struct SnappyArrayWriter *stage, char *dst,
+		uint32_t *flushed, uint32_t dst_len,
+		const char **src_ptr, const char *src_end)
+{
+	const char *src = *src_ptr;
+	const uint8_t opcode = *(const uint8_t *)src++;
+	const uint32_t extra_bytes = (opcode >> 2) - 59;
+	uint32_t length = get_unaligned_le(src, extra_bytes) + 1;
+	uint32_t n;
+	src += extra_bytes;
+	if (unlikely((uint32_t)(src_end - src) < length))
+		return CSNAPPY_E_DATA_MALFORMED;
+	if (unlikely(dst_len - *flushed - (stage->op - stage->base) < length))
+		return CSNAPPY_E_OUTPUT_OVERRUN;
+	for (;;) {
+		n = stage->base + CSNAPPY_NT_WORKMEM_BYTES - stage->op;
+		if (n > length)
+			n = length;
+		memcpy(stage->op, src, n);
+		stage->op += n;
+		src += n;
+		length -= n;
+		if (!length)
+			break;
+		NTSlide(stage, dst, flushed);
+	}
+	*src_ptr = src;
+	return CSNAPPY_E_OK;
+}
+#endif /* CSNAPPY_HAVE_SSE2 */
+
+static ALWAYS_INLINE int
+DecompressNonTemporal(
+	const char	*src,
+	uint32_t	src_remaining,
+	char		*dst,
+	uint32_t	*dst_len,
+	char		*working_memory,
+	uint32_t	threshold,
+	incremental_copy_fn IncrementalCopyFastPath)
+{
+#if defined(CSNAPPY_HAVE_SSE2)
+	struct SnappyArrayWriter stage;
+	const char * const src_start = src;
+	const char * const src_end = src + src_remaining;
+	uint32_t flushed = 0;
+	int ret;
+
+	/*
+	 * Nearly incompressible data is mostly literals, which the stage
+	 * would only copy one more time.
+	 */
+	if (!threshold || *dst_len < threshold ||
+	    src_remaining > *dst_len - *dst_len / 8)
+		goto ordinary;
+	stage.base = stage.op = working_memory;
+	for (;;) {
+		NTLimit(&stage, *dst_len - flushed);
+		ret = DecompressBulkTags(&stage, &src, src_end,
+					 IncrementalCopyFastPath);
+		if (ret == CSNAPPY_E_OUTPUT_OVERRUN) {
+			ret = NTAppendLiteral(&stage, dst, &flushed, *dst_len,
+					      &src, src_end);
+			if (ret < 0)
+				goto out;
+			continue;
+		}
+		if (ret < 0)
+			goto out;
+		/* Out of input or output for the bulk loop. */
+		if (src_end - src <= kSlopBytes ||
+		    stage.op_limit - stage.base < CSNAPPY_NT_WORKMEM_BYTES)
+			break;
+		NTSlide(&stage, dst, &flushed);
+	}
+	if (stage.op - stage.base > kNTWindow + 64)
+		NTSlide(&stage, dst, &flushed);
+	NTLimit(&stage, *dst_len - flushed);
+	ret = DecompressTailTags(&stage, src, src_end - src,
+				 IncrementalCopyFastPath);
+out:
+	_mm_sfence();
+	if (ret == CSNAPPY_E_DATA_MALFORMED) {
+		src = src_start;
+		goto ordinary;
+	}
+	if (ret < 0)
+		return ret;
+	memcpy(dst + flushed, stage.base, stage.op - stage.base);
+	*dst_len = flushed + (stage.op - stage.base);
+	return CSNAPPY_E_OK;
+ordinary:
+#endif
+	return DecompressNoHeader(src, src_remaining, dst, dst_len,
+				  IncrementalCopyFastPath);
+}
+
+#if defined(CSNAPPY_DISPATCH_X86)
+int
+csnappy_decompress_noheader_nt_generic(
+	const char	*src,
+	uint32_t	src_remaining,
+	char		*dst,
+	uint32_t	*dst_len,
+	void		*working_memory,
+	uint32_t	threshold)
+{
+	return DecompressNonTemporal(src, src_remaining, dst, dst_len,
+				     working_memory, threshold,
+				     IncrementalCopyFastPath_generic);
+}
+
+int CSNAPPY_TARGET("ssse3")
+csnappy_decompress_noheader_nt_ssse3(
+	const char	*src,
+	uint32_t	src_remaining,
+	char		*dst,
+	uint32_t	*dst_len,
+	void		*working_memory,
+	uint32_t	threshold)
+{
+	return DecompressNonTemporal(src, src_remaining, dst, dst_len,
+				     working_memory, threshold,
+				     IncrementalCopyFastPath_shuffle);
+}
+#endif /* CSNAPPY_DISPATCH_X86 */
+
+int
+csnappy_decompress_noheader_nt(
+	const char	*src,
+	uint32_t	src_remaining,
+	char		*dst,
+	uint32_t	*dst_len,
+	void		*working_memory,
+	uint32_t	threshold)
+{
+#if defined(CSNAPPY_DISPATCH_X86)
+	return csnappy_kernels.decompress_noheader_nt(src, src_remaining,
+			dst, dst_len, working_memory, threshold);
+#else
+	return DecompressNonTemporal(src, src_remaining, dst, dst_len,
+				     working_memory, threshold,
+				     IncrementalCopyFastPath_best);
+#endif
+}
+
+/*
+ * Experimental two-phase decoder.
+ *
+ * The first phase parses up to kOpBatch tags into an array of SnappyOps,
+ * resolving every literal and copy to the address it reads from, without
+ * touching the output. Offsets and the output length are checked once per
+ * batch rather than once per tag, by accumulating the results of the
+ * comparisons. The second phase executes the batch, prefetching the source
+ * of the copy kPrefetchDistance ops ahead, which the interleaved loop
+ * cannot know early enough to do.
+ *
+ * Batches are parsed while the bulk loop's slop is available on both sides,
+ * and so stop short of the end of the output by that much, so that every
+ * op can be executed with the bulk loop's wide moves. DecompressTailTags
+ * decodes whatever is left.
+ */
+#define kOpBatch 64
+#define kPrefetchDistance 8
+
+enum {
+	SNAPPY_OP_SHORT_LITERAL,	/* literal of at most 60 bytes */
+	SNAPPY_OP_LITERAL,
+	SNAPPY_OP_COPY
+};
+
+struct SnappyOp {
+	const char *from;
+	uint32_t length;
+	uint32_t kind;
+};
+
+static INLINE int
+DecompressTwoPhaseTags(struct SnappyArrayWriter *writer,
+		       const char **src_ptr, const char *src_end)
+{
+	struct SnappyOp ops[kOpBatch];
+	const char *src = *src_ptr;
+	char *op = writer->op;
+	const uint32_t space = writer->op_limit - writer->base;
+	uint32_t start, produced, room, length, trailer, opword, extra_bytes;
+	uint32_t bad, i, j, n;
+	uint8_t opcode;
+
+	while (src_end - src > kSlopBytes && writer->op_limit - op >
+				kSlopBytes + kMaxIncrementCopyOverflow) {
+		/* Output that the batch may start ops in, keeping the slop. */
+		room = writer->op_limit - op -
+				(kSlopBytes + kMaxIncrementCopyOverflow);
+		start = produced = op - writer->base;
+		bad = 0;
+		for (n = 0; n < kOpBatch && src_end - src > kSlopBytes &&
+				produced - start < room; ++n) {
+			opcode = *(const uint8_t *)src++;
+			opword = char_table[opcode];
+			extra_bytes = opword >> 11;
+			trailer = get_unaligned_le(src, extra_bytes);
+			length = opword & 0xff;
+			src += extra_bytes;
+			if (opcode & 0x3) {
+				trailer += opword & 0x700;
+				/* -1u catches offset==0 */
+				bad |= produced <= trailer - 1u;
+				ops[n].from = writer->base + produced - trailer;
+				ops[n].kind = SNAPPY_OP_COPY;
+			} else if (likely(!extra_bytes)) {
+				ops[n].from = src;
+				ops[n].kind = SNAPPY_OP_SHORT_LITERAL;
+				src += length;
+			} else {
+				length = trailer + 1;
+				if (unlikely((uint32_t)(src_end - src) < length))
+					return CSNAPPY_E_DATA_MALFORMED;
+				if (unlikely(space - produced < length))
+					return CSNAPPY_E_OUTPUT_OVERRUN;
+				ops[n].from = src;
+				ops[n].kind = SNAPPY_OP_LITERAL;
+				src += length;
+			}
+			ops[n].length = length;
+			produced += length;
+		}
+		/*
+		 * Leave the batch to DecompressTailTags, which stops at the
+		 * first bad offset with the output up to it written.
+		 */
+		if (unlikely(bad))
+			break;
+		for (i = 0; i < n; ++i) {
+			const char *from = ops[i].from;
+			length = ops[i].length;
+			if (likely(i + kPrefetchDistance < n))
+				prefetch(ops[i + kPrefetchDistance].from);
+			if (ops[i].kind == SNAPPY_OP_COPY) {
+				if (likely(op - from >= 8)) {
+					UnalignedCopy64(from, op);
+					UnalignedCopy64(from + 8, op + 8);
+					for (j = 16; unlikely(j < length); j += 8)
+						UnalignedCopy64(from + j, op + j);
+				} else {
+					IncrementalCopyFastPath_best(from, op,
+								     length);
+				}
+			} else if (ops[i].kind == SNAPPY_OP_SHORT_LITERAL) {
+				memcpy(op, from, 32);
+				if (unlikely(length > 32))
+					memcpy(op + 32, from + 32, 32);
+			} else {
+				memcpy(op, from, length);
+			}
+			op += length;
+		}
+		writer->op = op;
+		*src_ptr = src;
+	}
+	return CSNAPPY_E_OK;
+}
+
+int
+csnappy_decompress_noheader_twophase(
+	const char	*src,
+	uint32_t	src_remaining,
+	char		*dst,
+	uint32_t	*dst_len)
+{
+	struct SnappyArrayWriter writer;
+	const char * const src_end = src + src_remaining;
+	int ret;
+	writer.op = writer.base = dst;
+	writer.op_limit = writer.op + *dst_len;
+	ret = DecompressTwoPhaseTags(&writer, &src, src_end);
+	if (ret < 0)
+		return ret;
+	ret = DecompressTailTags(&writer, src, src_end - src,
+				 IncrementalCopyFastPath_best);
+	if (ret < 0)
+		return ret;
 	*dst_len = writer.op - writer.base;
 	return CSNAPPY_E_OK;
 }
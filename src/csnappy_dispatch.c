@@ -0,0 +1,263 @@
+/*
+Run time selection of instruction set specific kernels.
+
+The compressor and decompressor are built once per instruction set, with
+target attributes, when the compiler can do that and can ask the CPU what
+it supports (CSNAPPY_DISPATCH_X86). Every build, including those that
+cannot, answers csnappy_kernels_name() and friends, naming the kernels
+chosen at compile time.
+
+Not for the kernel, which has no use for either.
+*/
+
+#include "csnappy_internal.h"
+#include "csnappy.h"
+
+#if defined(CSNAPPY_DISPATCH_X86)
+
+struct csnappy_variant {
+	const char *name;
+	/* Comma separated features the CPU needs, as "target" spells them. */
+	const char *features;
+	/* Not chosen unless asked for by name. */
+	int by_name;
+	csnappy_compress_fragment_fn compress_fragment;
+	csnappy_decompress_noheader_fn decompress_noheader;
+	csnappy_decompress_noheader_fn decompress_noheader_trusted;
+	csnappy_decompress_noheader_nt_fn decompress_noheader_nt;
+	csnappy_decompress_noheader_multi_fn decompress_noheader_multi;
+};
+
+/*
+ * From the most basic to the best, then those only used when asked for:
+ * the BMI2 decoder, which is slower than the SSSE3 one on text so far.
+ */
+static const struct csnappy_variant csnappy_variants[] = {
+	{ "generic", "", 0,
+	  csnappy_compress_fragment_generic,
+	  csnappy_decompress_noheader_generic,
+	  csnappy_decompress_noheader_trusted_generic,
+	  csnappy_decompress_noheader_nt_generic,
+	  csnappy_decompress_noheader_multi_generic },
+	{ "sse2", "sse2", 0,
+	  csnappy_compress_fragment_sse2,
+	  csnappy_decompress_noheader_generic,
+	  csnappy_decompress_noheader_trusted_generic,
+	  csnappy_decompress_noheader_nt_generic,
+	  csnappy_decompress_noheader_multi_generic },
+	{ "ssse3", "sse2,ssse3", 0,
+	  csnappy_compress_fragment_sse2,
+	  csnappy_decompress_noheader_ssse3,
+	  csnappy_decompress_noheader_trusted_ssse3,
+	  csnappy_decompress_noheader_nt_ssse3,
+	  csnappy_decompress_noheader_multi_ssse3 },
+	{ "avx2", "sse2,ssse3,avx2", 0,
+	  csnappy_compress_fragment_avx2,
+	  csnappy_decompress_noheader_ssse3,
+	  csnappy_decompress_noheader_trusted_ssse3,
+	  csnappy_decompress_noheader_nt_ssse3,
+	  csnappy_decompress_noheader_multi_ssse3 },
+	{ "avx512", "sse2,ssse3,avx2,avx512bw,avx512vl", 0,
+	  csnappy_compress_fragment_avx512,
+	  csnappy_decompress_noheader_ssse3,
+	  csnappy_decompress_noheader_trusted_ssse3,
+	  csnappy_decompress_noheader_nt_ssse3,
+	  csnappy_decompress_noheader_multi_ssse3 },
+	{ "bmi2", "sse2,ssse3,avx2,bmi2", 1,
+	  csnappy_compress_fragment_avx2,
+	  csnappy_decompress_noheader_bmi2,
+	  csnappy_decompress_noheader_trusted_ssse3,
+	  csnappy_decompress_noheader_nt_ssse3,
+	  csnappy_decompress_noheader_multi_ssse3 }
+};
+#define NUM_VARIANTS \
+	((int)(sizeof(csnappy_variants) / sizeof(csnappy_variants[0])))
+
+/*
+ * __builtin_cpu_supports() only takes string literals, so the features
+ * are spelled out once here.
+ */
+static int cpu_has(const char *feature, size_t len)
+{
+#define CPU_HAS(f) \
+	if (len == sizeof(f) - 1 && !memcmp(feature, f, len)) \
+		return __builtin_cpu_supports(f)
+	CPU_HAS("sse2");
+	CPU_HAS("ssse3");
+	CPU_HAS("avx2");
+	CPU_HAS("bmi2");
+	CPU_HAS("avx512bw");
+	CPU_HAS("avx512vl");
+#undef CPU_HAS
+	return 0;
+}
+
+static int variant_supported(const struct csnappy_variant *v)
+{
+	const char *f = v->features, *comma;
+	__builtin_cpu_init();
+	while (*f) {
+		comma = strchr(f, ',');
+		if (!comma)
+			comma = f + strlen(f);
+		if (!cpu_has(f, comma - f))
+			return 0;
+		f = *comma ? comma + 1 : comma;
+	}
+	return 1;
+}
+
+static int selected = -1;
+
+static char *resolve_compress_fragment(const char *input,
+	const uint32_t input_length, char *output, void *working_memory,
+	const int workmem_bytes_power_of_two, const int mode);
+static int resolve_decompress_noheader(const char *src, uint32_t src_len,
+	char *dst, uint32_t *dst_len);
+static int resolve_decompress_noheader_trusted(const char *src,
+	uint32_t src_len, char *dst, uint32_t *dst_len);
+static int resolve_decompress_noheader_nt(const char *src, uint32_t src_len,
+	char *dst, uint32_t *dst_len, void *working_memory,
+	uint32_t threshold);
+static int resolve_decompress_noheader_multi(uint32_t n,
+	const char * const *src, const uint32_t *src_len, char * const *dst,
+	uint32_t *dst_len, int *status);
+
+struct csnappy_kernels csnappy_kernels = {
+	resolve_compress_fragment,
+	resolve_decompress_noheader,
+	resolve_decompress_noheader_trusted,
+	resolve_decompress_noheader_nt,
+	resolve_decompress_noheader_multi
+};
+
+static char *resolve_compress_fragment(const char *input,
+	const uint32_t input_length, char *output, void *working_memory,
+	const int workmem_bytes_power_of_two, const int mode)
+{
+	csnappy_select_kernels(NULL);
+	return csnappy_kernels.compress_fragment(input, input_length, output,
+			working_memory, workmem_bytes_power_of_two, mode);
+}
+
+static int resolve_decompress_noheader(const char *src, uint32_t src_len,
+	char *dst, uint32_t *dst_len)
+{
+	csnappy_select_kernels(NULL);
+	return csnappy_kernels.decompress_noheader(src, src_len, dst, dst_len);
+}
+
+static int resolve_decompress_noheader_trusted(const char *src,
+	uint32_t src_len, char *dst, uint32_t *dst_len)
+{
+	csnappy_select_kernels(NULL);
+	return csnappy_kernels.decompress_noheader_trusted(src, src_len,
+			dst, dst_len);
+}
+
+static int resolve_decompress_noheader_nt(const char *src, uint32_t src_len,
+	char *dst, uint32_t *dst_len, void *working_memory,
+	uint32_t threshold)
+{
+	csnappy_select_kernels(NULL);
+	return csnappy_kernels.decompress_noheader_nt(src, src_len, dst,
+			dst_len, working_memory, threshold);
+}
+
+static int resolve_decompress_noheader_multi(uint32_t n,
+	const char * const *src, const uint32_t *src_len, char * const *dst,
+	uint32_t *dst_len, int *status)
+{
+	csnappy_select_kernels(NULL);
+	return csnappy_kernels.decompress_noheader_multi(n, src, src_len,
+			dst, dst_len, status);
+}
+
+int
+csnappy_select_kernels(const char *name)
+{
+	int i;
+	for (i = NUM_VARIANTS - 1; i >= 0; --i) {
+		if (name ? strcmp(name, csnappy_variants[i].name) :
+			   csnappy_variants[i].by_name)
+			continue;
+		if (!variant_supported(&csnappy_variants[i])) {
+			if (name)
+				return CSNAPPY_E_KERNEL_UNSUPPORTED;
+			continue;
+		}
+		csnappy_kernels.compress_fragment =
+			csnappy_variants[i].compress_fragment;
+		csnappy_kernels.decompress_noheader =
+			csnappy_variants[i].decompress_noheader;
+		csnappy_kernels.decompress_noheader_trusted =
+			csnappy_variants[i].decompress_noheader_trusted;
+		csnappy_kernels.decompress_noheader_nt =
+			csnappy_variants[i].decompress_noheader_nt;
+		csnappy_kernels.decompress_noheader_multi =
+			csnappy_variants[i].decompress_noheader_multi;
+		selected = i;
+		return CSNAPPY_E_OK;
+	}
+	return CSNAPPY_E_KERNEL_UNSUPPORTED;
+}
+
+const char *
+csnappy_kernels_name(void)
+{
+	if (selected < 0)
+		csnappy_select_kernels(NULL);
+	return csnappy_variants[selected].name;
+}
+
+const char *
+csnappy_kernels_available(int i)
+{
+	int j;
+	for (j = 0; j < NUM_VARIANTS; ++j) {
+		if (!variant_supported(&csnappy_variants[j]))
+			continue;
+		if (i-- == 0)
+			return csnappy_variants[j].name;
+	}
+	return NULL;
+}
+
+#else /* !CSNAPPY_DISPATCH_X86 */
+
+#if defined(CSNAPPY_HAVE_AVX512)
+#define KERNELS_NAME "avx512"
+#elif defined(CSNAPPY_HAVE_AVX2)
+#define KERNELS_NAME "avx2"
+#elif defined(CSNAPPY_HAVE_SSSE3)
+#define KERNELS_NAME "ssse3"
+#elif defined(CSNAPPY_HAVE_SSE2)
+#define KERNELS_NAME "sse2"
+#elif defined(CSNAPPY_HAVE_NEON)
+#define KERNELS_NAME "neon"
+#else
+#define KERNELS_NAME "generic"
+#endif
+
+int
+csnappy_select_kernels(const char *name)
+{
+	if (name && strcmp(name, KERNELS_NAME))
+		return CSNAPPY_E_KERNEL_UNSUPPORTED;
+	return CSNAPPY_E_OK;
+}
+
+const char *
+csnappy_kernels_name(void)
+{
+	return KERNELS_NAME;
+}
+
+const char *
+csnappy_kernels_available(int i)
+{
+	return i == 0 ? KERNELS_NAME : NULL;
+}
+
+#undef KERNELS_NAME
+#endif /* !CSNAPPY_DISPATCH_X86 */
@@ -40,6 +40,7 @@ Steffen Mueller <smueller@cpan.org>
 #define CSNAPPY_INTERNAL_H_
 
 #include "csnappy_compat.h"
+#include "csnappy_simd.h"
 
 #ifndef __KERNEL__
 #include "csnappy_internal_userspace.h"
@@ -49,6 +50,7 @@ Steffen Mueller <smueller@cpan.org>
 #include <linux/types.h>
 #include <linux/string.h>
 #include <linux/compiler.h>
+#include <linux/prefetch.h>
 #include <asm/byteorder.h>
 #include <asm/unaligned.h>
 
@@ -146,6 +148,63 @@ static INLINE void UnalignedCopy64(const void *src, void *dst) {
 #define DCHECK_LT(a, b)	DCHECK(((a) <  (b)))
 #define DCHECK_LE(a, b)	DCHECK(((a) <= (b)))
 
+#if defined(CSNAPPY_DISPATCH_X86)
+/*
+ * The instruction set specific variants of the hot loops, and the set
+ * currently in use, which csnappy_select_kernels() in csnappy_dispatch.c
+ * fills in. Until then it points at resolvers that pick the best set for
+ * the CPU on first use.
+ */
+typedef char *(*csnappy_compress_fragment_fn)(
+	const char *input, const uint32_t input_length, char *output,
+	void *working_memory, const int workmem_bytes_power_of_two,
+	const int mode);
+typedef int (*csnappy_decompress_noheader_fn)(
+	const char *src, uint32_t src_len, char *dst, uint32_t *dst_len);
+typedef int (*csnappy_decompress_noheader_nt_fn)(
+	const char *src, uint32_t src_len, char *dst, uint32_t *dst_len,
+	void *working_memory, uint32_t threshold);
+typedef int (*csnappy_decompress_noheader_multi_fn)(
+	uint32_t n, const char * const *src, const uint32_t *src_len,
+	char * const *dst, uint32_t *dst_len, int *status);
+
+struct csnappy_kernels {
+	csnappy_compress_fragment_fn compress_fragment;
+	csnappy_decompress_noheader_fn decompress_noheader;
+	csnappy_decompress_noheader_fn decompress_noheader_trusted;
+	csnappy_decompress_noheader_nt_fn decompress_noheader_nt;
+	csnappy_decompress_noheader_multi_fn decompress_noheader_multi;
+};
+extern struct csnappy_kernels csnappy_kernels;
+
+char *csnappy_compress_fragment_generic(const char *, const uint32_t,
+					char *, void *, const int, const int);
+char *csnappy_compress_fragment_sse2(const char *, const uint32_t,
+				     char *, void *, const int, const int);
+char *csnappy_compress_fragment_avx2(const char *, const uint32_t,
+				     char *, void *, const int, const int);
+char *csnappy_compress_fragment_avx512(const char *, const uint32_t,
+				       char *, void *, const int, const int);
+int csnappy_decompress_noheader_generic(const char *, uint32_t,
+					char *, uint32_t *);
+int csnappy_decompress_noheader_ssse3(const char *, uint32_t,
+				      char *, uint32_t *);
+int csnappy_decompress_noheader_bmi2(const char *, uint32_t,
+				     char *, uint32_t *);
+int csnappy_decompress_noheader_trusted_generic(const char *, uint32_t,
+						char *, uint32_t *);
+int csnappy_decompress_noheader_trusted_ssse3(const char *, uint32_t,
+					      char *, uint32_t *);
+int csnappy_decompress_noheader_nt_generic(const char *, uint32_t,
+					   char *, uint32_t *, void *, uint32_t);
+int csnappy_decompress_noheader_nt_ssse3(const char *, uint32_t,
+					 char *, uint32_t *, void *, uint32_t);
+int csnappy_decompress_noheader_multi_generic(uint32_t, const char * const *,
+	const uint32_t *, char * const *, uint32_t *, int *);
+int csnappy_decompress_noheader_multi_ssse3(uint32_t, const char * const *,
+	const uint32_t *, char * const *, uint32_t *, int *);
+#endif /* CSNAPPY_DISPATCH_X86 */
+
 enum {
 	LITERAL = 0,
 	COPY_1_BYTE_OFFSET = 1,  /* 3 bit length + 3 bits of offset in opcode */
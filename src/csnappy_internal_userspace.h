@@ -89,6 +89,13 @@ typedef __int32 int32_t; /* Sereal specific change, see csnappy_decompress.c(271
 #define likely(x)	__builtin_expect(!!(x), 1)
 #define unlikely(x)	__builtin_expect(!!(x), 0)
 
+/* Software prefetch for reading, where the compiler has it. */
+#ifdef __GNUC__
+#define prefetch(p)	__builtin_prefetch(p)
+#else
+#define prefetch(p)	((void)(p))
+#endif
+
 
 #ifdef DEBUG
 #include <assert.h>
@@ -269,6 +276,7 @@ static INLINE void UNALIGNED_STORE64(void *p, uint64_t v)
 #if __BYTE_ORDER == __LITTLE_ENDIAN
 #define get_unaligned_le32(p)           UNALIGNED_LOAD32(p)
 #define put_unaligned_le16(v, p)        UNALIGNED_STORE16(p, v)
+#define put_unaligned_le32(v, p)        UNALIGNED_STORE32(p, v)
 #elif __BYTE_ORDER == __BIG_ENDIAN
 static INLINE uint32_t get_unaligned_le32(const void *p)
 {
@@ -278,6 +286,10 @@ static INLINE void put_unaligned_le16(uint16_t val, void *p)
 {
   UNALIGNED_STORE16(p, bswap_16(val));
 }
+static INLINE void put_unaligned_le32(uint32_t val, void *p)
+{
+  UNALIGNED_STORE32(p, bswap_32(val));
+}
 #else
 static INLINE uint32_t get_unaligned_le32(const void *p)
 {
@@ -290,6 +302,14 @@ static INLINE void put_unaligned_le16(uint16_t val, void *p)
   b[0] = val & 255;
   b[1] = val >> 8;
 }
+static INLINE void put_unaligned_le32(uint32_t val, void *p)
+{
+  uint8_t *b = (uint8_t *)p;
+  b[0] = val & 255;
+  b[1] = (val >> 8) & 255;
+  b[2] = (val >> 16) & 255;
+  b[3] = val >> 24;
+}
 #endif
 
 
@@ -0,0 +1,85 @@
+#ifndef CSNAPPY_SIMD_H_
+#define CSNAPPY_SIMD_H_
+
+/*
+ * Vector instruction sets available to the compiler for this build.
+ *
+ * CSNAPPY_HAVE_<ISA> is keyed off the compiler's own predefined macros, so
+ * it follows the -m/-march flags the module is built with. Define
+ * CSNAPPY_NO_SIMD to force the scalar code paths. Never used in the kernel,
+ * where the FPU/vector state may not be touched without kernel_fpu_begin().
+ */
+
+#if !defined(__KERNEL__) && !defined(CSNAPPY_NO_SIMD)
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CSNAPPY_HAVE_SSE2 1
+#endif
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define CSNAPPY_HAVE_SSSE3 1
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CSNAPPY_HAVE_AVX2 1
+#endif
+
+#if defined(__AVX512BW__) && defined(__AVX512VL__)
+#include <immintrin.h>
+#define CSNAPPY_HAVE_AVX512 1
+#endif
+
+/* The byte mask tricks used with NEON assume little endian lane order. */
+#if defined(__aarch64__) && defined(__ARM_NEON) && \
+    defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#define CSNAPPY_HAVE_NEON 1
+#endif
+
+/*
+ * Kernels for instruction sets beyond the build's baseline are compiled
+ * with target attributes and selected at run time after asking the CPU,
+ * see csnappy_dispatch.c. Makefile.PL defines HAVE_BUILTIN_CPU_SUPPORTS
+ * when the compiler can do both.
+ */
+#if defined(HAVE_BUILTIN_CPU_SUPPORTS) && \
+    (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CSNAPPY_DISPATCH_X86 1
+#endif
+
+#endif /* !__KERNEL__ && !CSNAPPY_NO_SIMD */
+
+/*
+ * CSNAPPY_BUILD_<ISA> says whether kernels for an instruction set are
+ * compiled at all: always when dispatching at run time, otherwise only
+ * when the baseline already has it. CSNAPPY_TARGET() marks such kernels
+ * and is empty unless dispatching.
+ */
+#if defined(CSNAPPY_DISPATCH_X86)
+#define CSNAPPY_BUILD_SSE2 1
+#define CSNAPPY_BUILD_SSSE3 1
+#define CSNAPPY_BUILD_AVX2 1
+#define CSNAPPY_BUILD_AVX512 1
+#define CSNAPPY_TARGET(isa) __attribute__((target(isa)))
+#else
+#if defined(CSNAPPY_HAVE_SSE2)
+#define CSNAPPY_BUILD_SSE2 1
+#endif
+#if defined(CSNAPPY_HAVE_SSSE3)
+#define CSNAPPY_BUILD_SSSE3 1
+#endif
+#if defined(CSNAPPY_HAVE_AVX2)
+#define CSNAPPY_BUILD_AVX2 1
+#endif
+#if defined(CSNAPPY_HAVE_AVX512)
+#define CSNAPPY_BUILD_AVX512 1
+#endif
+#define CSNAPPY_TARGET(isa) /*NOTHING*/
+#endif
+
+#endif  /* CSNAPPY_SIMD_H_ */
@@ -17,6 +17,151 @@ for my $len (0 .. 1_024) {
     is($decompressed, $in, "length: $len");
 }
 
+# Matches of every length around the vector compare widths, with the end
+# of the match landing at varying distances from the end of the input.
+for my $len (1 .. 70) {
+    my $block = join '', map { chr int rand 256 } 1 .. $len;
+    for my $tail (0 .. 17) {
+        my $in = $block . $block . substr($block, 0, $tail % $len) . 'x';
+        my $decompressed = decompress(compress($in));
+        is($decompressed, $in, "match length: $len, tail: $tail")
+            or last;
+    }
+}
+
+# Short periodic patterns, which decompress through overlapping copies.
+for my $period (1 .. 17) {
+    my $pattern = join '', map { chr(65 + $_) } 0 .. $period - 1;
+    for my $len (4 .. 80) {
+        my $in = 'x' . substr($pattern x (1 + $len / $period), 0, $len);
+        my $decompressed = decompress(compress($in));
+        is($decompressed, $in, "period: $period, length: $len") or last;
+    }
+}
+
+# Long runs of one and two byte patterns, ending at every alignment.
+for my $pattern ("\0", 'ab') {
+    for my $len (4_000 .. 4_003, 100_000) {
+        my $in = 'x' . $pattern x ($len / length $pattern) . 'y' . $pattern x 9;
+        my $compressed = compress($in);
+        is(decompress($compressed), $in, "run of '$pattern', length: $len");
+        is(Compress::Snappy::decompress_trusted($compressed), $in,
+            "trusted run of '$pattern', length: $len");
+    }
+}
+
+# The other modes, on repetitive text and on blocks of random bytes.
+{
+    my $text = join ' ', map { ('lorem', 'ipsum', 'dolor', "sit$_", 'amet')
+        [$_ % 5] } 1 .. 20_000;
+    for my $in ($text, substr($text, 0, 100), join '', map { chr int rand 256 }
+            1 .. 70_000) {
+        my $len = length $in;
+        for my $mode ('dual', 'tagged', 'decode') {
+            is(decompress(compress($in, $mode)), $in,
+                "$mode, length: $len");
+        }
+    }
+    cmp_ok(length compress($text, 'dual'), '<=', length compress($text),
+        'dual compresses text no worse');
+    is(compress($text, 'fast'), compress($text), 'fast is the default');
+    ok(!eval { compress($text, 'best'); 1 }, 'unknown mode');
+}
+
+# The decoders each set of kernels has, on bad input as well as good.
+for my $kernel (Compress::Snappy::kernels()) {
+    Compress::Snappy::kernel($kernel);
+
+    # Several buffers at once, good and bad, in a batch longer than the
+    # lanes.
+    {
+        my @in = map { join '', map { chr(97 + $_ % 5) x ($_ % 9) } 0 .. $_ }
+            0, 1, 10, 100, 300, 1_000, 3_000, 20;
+        my @buffers = (map({ compress($_) } @in), undef, '',
+            "\x64\x00a\x09\x05");
+        my @expect = map { decompress($_) } @buffers;
+        is_deeply([ Compress::Snappy::decompress_multi(@buffers) ], \@expect,
+            "$kernel: decompress_multi");
+        is_deeply([ Compress::Snappy::decompress_multi(reverse @buffers) ],
+            [ reverse @expect ], "$kernel: decompress_multi, reversed");
+        is_deeply([ Compress::Snappy::decompress_multi(@buffers[3, 4, -1]) ],
+            [ @expect[3, 4, -1] ], "$kernel: decompress_multi, few");
+        is_deeply([ Compress::Snappy::decompress_multi() ], [],
+            "$kernel: decompress_multi, nothing");
+        ok(!eval { Compress::Snappy::decompress_multi($buffers[0], "\x{100}");
+            1 }, "$kernel: decompress_multi, wide character");
+    }
+
+    # The trusted decoder, on valid data around the bulk loop's limits.
+    for my $len (0 .. 200, 1_000, 70_000) {
+        my $in = join '', map { chr(65 + $_ % 7) x (1 + $_ % 13) } 0 .. $len;
+        $in = substr($in, 0, $len) . join '', map { chr int rand 256 }
+            1 .. $len;
+        is(Compress::Snappy::decompress_trusted(compress($in)), $in,
+            "$kernel: trusted, length: $len") or last;
+    }
+
+    # Non-temporal stores, forced on for outputs of every size.
+    {
+        my $default = Compress::Snappy::nt_threshold();
+        is(Compress::Snappy::nt_threshold(1), 1, "$kernel: nt_threshold set");
+        for my $len (0, 100, 65_536, 300_000, 1_000_000) {
+            my $in = join '', map { ('foo', 'bar', 'baz', $_)[$_ % 4] }
+                1 .. $len;
+            $in = substr $in, 0, $len;
+            is(decompress(compress($in)), $in,
+                "$kernel: non-temporal, length: $len");
+        }
+        is(decompress("\x64\x00a\x09\x05" . 'x' x 100), undef,
+            "$kernel: non-temporal, offset beyond output");
+        Compress::Snappy::nt_threshold($default);
+    }
+
+    # Malformed input, both within reach of the end of the input and not.
+    for my $pad (0, 100) {
+        my $tail = 'x' x $pad;
+        is(decompress("\x64\xfc\xfe\xff\xff\xff$tail"), undef,
+            "$kernel: literal length overflow, padding: $pad");
+        is(decompress("\x64\x00a\x09\x05$tail"), undef,
+            "$kernel: offset beyond output, padding: $pad");
+        is(decompress("\x64\x00a\x01\x00$tail"), undef,
+            "$kernel: offset zero, padding: $pad");
+    }
+    is(decompress("\x10\x00a\x03\x01"), undef,
+        "$kernel: truncated copy offset");
+}
+Compress::Snappy::kernel(undef);
+
+# The experimental two phase decoder, on good and bad input.
+for my $len (0 .. 200, 1_000, 70_000) {
+    my $in = join '', map { chr(65 + $_ % 7) x (1 + $_ % 13) } 0 .. $len;
+    $in = substr($in, 0, $len) . join '', map { chr int rand 256 } 1 .. $len;
+    is(Compress::Snappy::decompress_twophase(compress($in)), $in,
+        "two phase, length: $len") or last;
+}
+for my $in ('a' x 100_000, join ' ', map { int rand 1_000 } 1 .. 20_000) {
+    is(Compress::Snappy::decompress_twophase(compress($in)), $in,
+        'two phase, length: ' . length $in);
+}
+for my $pad (0, 100) {
+    my $tail = 'x' x $pad;
+    for my $in ("\x64\xfc\xfe\xff\xff\xff", "\x64\x00a\x09\x05",
+            "\x64\x00a\x01\x00") {
+        is(Compress::Snappy::decompress_twophase($in . $tail), undef,
+            'two phase, malformed: ' . unpack('H*', $in) . ", padding: $pad");
+    }
+}
+{
+    my $compressed = compress(join ' ', map { int rand 1_000 } 1 .. 5_000);
+    for my $i (1 .. 200) {
+        my $mutated = $compressed;
+        substr($mutated, 1 + int rand(length($mutated) - 1), 1,
+            chr int rand 256) for 1 .. 1 + int rand 3;
+        is(Compress::Snappy::decompress_twophase($mutated),
+            decompress($mutated), "two phase, mutated $i") or last;
+    }
+}
+
 {
     my $scalar = '0' x 1_024;
     ok compress($scalar) eq compress(\$scalar), 'scalar ref';
@@ -33,4 +178,21 @@ for my $len (0 .. 1_024) {
     ok compress($scalar) eq compress('string'), 'blessed scalar ref';
 }
 
+{
+    package CountedFetch;
+    sub TIESCALAR { bless { value => $_[1], fetches => 0 }, $_[0] }
+    sub FETCH { $_[0]{fetches}++; $_[0]{value} }
+
+    package main;
+    my $in = '0' x 1_024;
+    my $tied = tie my $scalar, 'CountedFetch', $in;
+    my $compressed = compress($scalar);
+    ok $compressed eq compress($in), 'tied scalar';
+    is $tied->{fetches}, 1, 'tied scalar fetched once';
+    $tied->{value} = $compressed;
+    is decompress($scalar), $in, 'tied compressed scalar';
+    is_deeply [ Compress::Snappy::decompress_multi($scalar) ], [ $in ],
+        'tied compressed scalar, decompress_multi';
+}
+
 done_testing;
@@ -0,0 +1,34 @@
+use strict;
+use warnings;
+use Test::More;
+use Compress::Snappy;
+
+my $best = Compress::Snappy::kernel();
+my @kernels = Compress::Snappy::kernels();
+ok(scalar @kernels, 'kernels: ' . join ', ', @kernels);
+# bmi2 comes last, but is only used when asked for.
+my @default = grep { $_ ne 'bmi2' } @kernels;
+is($default[-1], $best, 'best kernels selected');
+is(Compress::Snappy::kernel('no such kernels'), undef, 'unknown kernels');
+is(Compress::Snappy::kernel(), $best, 'unchanged');
+
+my @inputs = (
+    'a' x 10_000,
+    join('', map { chr int rand 256 } 1 .. 5_000) x 3,
+    join(' ', map { int rand 1_000 } 1 .. 20_000),
+    join('', map { substr 'abcdefghijklmnop', 0, $_ } 1 .. 16) x 100,
+);
+
+my @expected = map { compress($_) } @inputs;
+for my $kernel (@kernels) {
+    is(Compress::Snappy::kernel($kernel), $kernel, "select $kernel");
+    for my $i (0 .. $#inputs) {
+        my $compressed = compress($inputs[$i]);
+        is($compressed, $expected[$i], "$kernel: same output $i");
+        is(decompress($compressed), $inputs[$i], "$kernel: round trip $i");
+    }
+}
+
+is(Compress::Snappy::kernel(undef), $best, 'back to best');
+
+done_testing;
@@ -0,0 +1,70 @@
+use strict;
+use warnings;
+use Test::More;
+use Compress::Snappy;
+
+my %inputs = (
+    run    => 'a' x 100_000,
+    random => join('', map { chr int rand 256 } 1 .. 5_000) x 3,
+    text   => join(' ', map { int rand 1_000 } 1 .. 20_000),
+    short  => 'abcabcabcabc' . 'xyz' x 10,
+);
+
+for my $name (sort keys %inputs) {
+    my $in = $inputs{$name};
+    my $compressed = compress($in);
+    my @elements;
+    my $stats = Compress::Snappy::analyze($compressed,
+        sub { push @elements, $_[0] });
+    ok($stats, "$name: analyzed") or next;
+    is($stats->{uncompressed}, length $in, "$name: uncompressed length");
+    is($stats->{compressed}, length $compressed, "$name: compressed length");
+
+    my ($count, $bytes) = (0, 0);
+    $count += $_ for values %{ $stats->{elements} };
+    $bytes += $_ for values %{ $stats->{bytes} };
+    is($count, scalar @elements, "$name: one callback per element");
+    is($bytes, length $in, "$name: bytes of all elements");
+
+    my ($in_pos, $out_pos, $copies) = ($stats->{header}, 0, 0);
+    for my $e (@elements) {
+        last unless $e->{in_pos} == $in_pos && $e->{out_pos} == $out_pos;
+        ($in_pos, $out_pos) = ($in_pos + $e->{in_len},
+            $out_pos + $e->{length});
+        $copies++ if $e->{tag} ne 'literal';
+    }
+    is_deeply([ $in_pos, $out_pos ], [ length $compressed, length $in ],
+        "$name: elements follow one another");
+    my $paths = 0;
+    $paths += $_ for values %{ $stats->{paths} };
+    is($paths, $copies, "$name: a path for every copy");
+
+    my ($block_in, $block_out) = (0, 0);
+    for (@{ $stats->{blocks} }) {
+        $block_in += $_->[0];
+        $block_out += $_->[1];
+    }
+    is_deeply([ $block_in, $block_out ],
+        [ length($compressed) - $stats->{header}, length $in ],
+        "$name: blocks");
+}
+
+my $run = Compress::Snappy::analyze(compress($inputs{run}));
+ok($run->{paths}{run}, 'runs of copies counted as such');
+is($run->{matches}, 4, 'one match for each 32 KiB of the run');
+
+# Whatever decompress() rejects, so does analyze(), and nothing else.
+my $compressed = compress($inputs{text});
+for my $i (1 .. 200) {
+    my $mutated = $compressed;
+    substr($mutated, 1 + int rand(length($mutated) - 1), 1, chr int rand 256)
+        for 1 .. 1 + int rand 3;
+    substr($mutated, 1 + int rand(length($mutated) - 1)) = '' if $i % 4 == 0;
+    my $decompressed = decompress($mutated);
+    is(defined Compress::Snappy::analyze($mutated), defined $decompressed,
+        "mutated $i") or last;
+}
+is(Compress::Snappy::analyze("\x64\x00a\x09\x05"), undef, 'malformed');
+is(Compress::Snappy::analyze(undef), undef, 'undef');
+
+done_testing;